@@ -0,0 +1,581 @@
+#include <opencv2/opencv.hpp>
+
+#include "tools.hpp"
+#include "Constants.hpp"
+#include "Calibration.hpp"
+#include "Sequence.hpp"
+#include "Tracking.hpp"
+#include "Triangulation.hpp"
+#include "Generator.hpp"
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+#include <numeric>
+#include <exception>
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+/**
+ * Options of the benchmark run.
+ */
+struct BenchmarkOptions {
+	/**
+	 * Frame sizes for the benchmarks working on images.
+	 */
+	vector<Size> frameSizes = { Size(640, 480) };
+
+	/**
+	 * Numbers of markers.
+	 */
+	vector<unsigned int> markers = { 10, 100 };
+
+	/**
+	 * Numbers of frames of the sequences.
+	 */
+	vector<unsigned int> frames = { 100, 400 };
+
+	/**
+	 * Minimal measured time of each benchmark in seconds.
+	 */
+	double minTime = 0.5;
+
+	/**
+	 * Minimal number of repetitions of each benchmark.
+	 */
+	unsigned int minRepetitions = 3;
+
+	/**
+	 * Only benchmarks whose name contains this text are run.
+	 */
+	string filter;
+
+	/**
+	 * The file to write the results to as JSON.
+	 */
+	string outputFile = "benchmark.json";
+
+	/**
+	 * Folder for the generated input and output files.
+	 */
+	string workFolder = "./";
+
+	/**
+	 * Folder with calibration data. If it is empty, synthetic calibration data is generated.
+	 */
+	string calibFolder;
+};
+
+/**
+ * Runs benchmarks repeatedly and collects the measured times.
+ */
+class BenchmarkRunner {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * \param[in] options Options of the benchmark run.
+	 */
+	BenchmarkRunner(const BenchmarkOptions &options) : options(options) {
+	}
+
+	/**
+	 * Get the full name of a benchmark, which contains the values of all parameters.
+	 *
+	 * \param[in] name Name of the benchmark.
+	 * \param[in] parameters Names and values of the parameters of the benchmark.
+	 * \returns The full name.
+	 */
+	static string getName(const string &name, const vector<pair<string, unsigned int>> &parameters) {
+		string result = name;
+		for (const auto &parameter : parameters) {
+			result += "/" + parameter.first + "=" + to_string(parameter.second);
+		}
+		return result;
+	}
+
+	/**
+	 * Check whether a benchmark is selected by the filter.
+	 *
+	 * \param[in] name Name of the benchmark.
+	 * \param[in] parameters Names and values of the parameters of the benchmark.
+	 * \returns True if the benchmark should be run.
+	 */
+	bool isSelected(const string &name, const vector<pair<string, unsigned int>> &parameters) const {
+		return options.filter.empty() || (getName(name, parameters).find(options.filter) != string::npos);
+	}
+
+	/**
+	 * Run a benchmark. It is executed once for warming up and then repeated until the minimal time and the minimal number of repetitions are reached.
+	 *
+	 * \param[in] name Name of the benchmark.
+	 * \param[in] parameters Names and values of the parameters of the benchmark.
+	 * \param[in] items Number of items processed by one execution, e.g. frames or positions.
+	 * \param[in] body The function to measure.
+	 */
+	template<typename F> void run(const string &name, const vector<pair<string, unsigned int>> &parameters, double items, F body) {
+		// skip benchmarks that are not selected
+		if (!isSelected(name, parameters)) {
+			return;
+		}
+		Measurement measurement;
+		measurement.name = getName(name, parameters);
+		measurement.parameters = parameters;
+		measurement.items = items;
+
+		// warm up caches and lazily created data
+		body();
+
+		// measure until the minimal time and repetitions are reached
+		double totalTime = 0;
+		while ((measurement.times.size() < options.minRepetitions) || (totalTime < options.minTime)) {
+			const auto start = chrono::steady_clock::now();
+			body();
+			const double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			measurement.times.push_back(time);
+			totalTime += time;
+		}
+		sort(measurement.times.begin(), measurement.times.end());
+
+		// report the benchmark
+		ostringstream message;
+		message << measurement.name << ": median " << setprecision(4) << getMedian(measurement) * 1e3 << " ms, " << setprecision(4) << (items / getMedian(measurement)) << " items/s";
+		logMessage(message.str());
+		measurements.push_back(measurement);
+	}
+
+	/**
+	 * Write all results as JSON.
+	 *
+	 * \param[in] file The file to write the results to.
+	 */
+	void writeJson(const string &file) const {
+		ofstream f(file, ios_base::out | ios_base::trunc);
+		if (!f.is_open()) {
+			throw "could not open file " + file + " for writing benchmark results.";
+		}
+
+		// describe the build and the machine, so results of different builds can be compared
+		auto t = time(nullptr);
+		f << "{\n  \"context\": {\n";
+		f << "    \"date\": \"" << put_time(localtime(&t), "%Y-%m-%dT%H:%M:%S") << "\",\n";
+#if defined(__VERSION__)
+		f << "    \"compiler\": \"" << escape(__VERSION__) << "\",\n";
+#elif defined(_MSC_VER)
+		f << "    \"compiler\": \"MSVC " << _MSC_VER << "\",\n";
+#endif
+		f << "    \"opencv\": \"" << CV_VERSION << "\",\n";
+#ifdef __AVX2__
+		f << "    \"avx2\": true,\n";
+#else
+		f << "    \"avx2\": false,\n";
+#endif
+#ifdef HEADLESS
+		f << "    \"headless\": true,\n";
+#else
+		f << "    \"headless\": false,\n";
+#endif
+		f << "    \"hardware_threads\": " << thread::hardware_concurrency() << "\n  },\n";
+
+		// write one object per benchmark with the statistics of its times
+		f << "  \"benchmarks\": [";
+		f << setprecision(9);
+		for (size_t i = 0; i < measurements.size(); ++i) {
+			const Measurement &m = measurements[i];
+			const double mean = accumulate(m.times.begin(), m.times.end(), 0.0) / m.times.size();
+			double variance = 0;
+			for (double time : m.times) {
+				variance += (time - mean) * (time - mean);
+			}
+			variance /= max<size_t>(m.times.size() - 1, 1);
+
+			f << (i == 0 ? "\n" : ",\n") << "    {\n";
+			f << "      \"name\": \"" << escape(m.name) << "\",\n";
+			f << "      \"parameters\": {";
+			for (size_t p = 0; p < m.parameters.size(); ++p) {
+				f << (p == 0 ? " " : ", ") << "\"" << escape(m.parameters[p].first) << "\": " << m.parameters[p].second;
+			}
+			f << " },\n";
+			f << "      \"repetitions\": " << m.times.size() << ",\n";
+			f << "      \"min_time\": " << m.times.front() << ",\n";
+			f << "      \"median_time\": " << getMedian(m) << ",\n";
+			f << "      \"mean_time\": " << mean << ",\n";
+			f << "      \"stddev_time\": " << sqrt(variance) << ",\n";
+			f << "      \"max_time\": " << m.times.back() << ",\n";
+			f << "      \"items_per_second\": " << (m.items / getMedian(m)) << "\n";
+			f << "    }";
+		}
+		f << "\n  ]\n}\n";
+
+		// check if everything has been written
+		f.close();
+		if (f.fail()) {
+			throw "could not write benchmark results to file " + file + ".";
+		}
+	}
+
+private:
+	/**
+	 * Measured times of a benchmark.
+	 */
+	struct Measurement {
+		/**
+		 * Name of the benchmark including its parameters.
+		 */
+		string name;
+
+		/**
+		 * Names and values of the parameters.
+		 */
+		vector<pair<string, unsigned int>> parameters;
+
+		/**
+		 * Number of items processed by one execution.
+		 */
+		double items;
+
+		/**
+		 * Sorted times of all repetitions in seconds.
+		 */
+		vector<double> times;
+	};
+
+	/**
+	 * Get the median time of a benchmark.
+	 *
+	 * \param[in] m The measured times.
+	 * \returns The median time in seconds.
+	 */
+	static double getMedian(const Measurement &m) {
+		const size_t n = m.times.size();
+		return (n % 2 == 1) ? m.times[n / 2] : 0.5 * (m.times[n / 2 - 1] + m.times[n / 2]);
+	}
+
+	/**
+	 * Escape a string for JSON.
+	 *
+	 * \param[in] str The string.
+	 * \returns The escaped string.
+	 */
+	static string escape(const string &str) {
+		string result;
+		for (char c : str) {
+			if ((c == '"') || (c == '\\')) {
+				result.push_back('\\');
+			}
+			result.push_back(((c >= 0) && (c < ' ')) ? ' ' : c);
+		}
+		return result;
+	}
+
+	/**
+	 * Options of the benchmark run.
+	 */
+	const BenchmarkOptions options;
+
+	/**
+	 * Results of all benchmarks run so far.
+	 */
+	vector<Measurement> measurements;
+};
+
+/**
+ * Get the positions of markers on a regular grid covering the inner part of an image.
+ *
+ * \param[in] frameSize Size of the image.
+ * \param[in] numberOfMarkers Number of markers.
+ * \returns The marker positions.
+ */
+static vector<Point2f> createMarkerGrid(Size frameSize, unsigned int numberOfMarkers) {
+	const float border = 40;
+	const float width = frameSize.width - 2 * border;
+	const float height = frameSize.height - 2 * border;
+	const unsigned int cols = max(1u, static_cast<unsigned int>(ceil(sqrt(numberOfMarkers * width / height))));
+	const unsigned int rows = (numberOfMarkers + cols - 1) / cols;
+	vector<Point2f> markers(numberOfMarkers);
+	for (unsigned int i = 0; i < numberOfMarkers; ++i) {
+		markers[i] = Point2f(border + width * (i % cols + 0.5f) / cols, border + height * (i / cols + 0.5f) / max(rows, 1u));
+	}
+	return markers;
+}
+
+/**
+ * Render a sequence of grayscale images with bright blobs at the marker positions. The blobs move on small circles.
+ *
+ * \param[in] frameSize Size of the images.
+ * \param[in] markers Marker positions in the first frame.
+ * \param[in] numberOfFrames Number of frames.
+ * \returns The rendered images.
+ */
+static vector<Mat> renderSequence(Size frameSize, const vector<Point2f> &markers, unsigned int numberOfFrames) {
+	vector<Mat> images(numberOfFrames);
+	for (unsigned int frame = 0; frame < numberOfFrames; ++frame) {
+		Mat img(frameSize, CV_8UC1, Scalar(0));
+		const float phase = frame * 0.05f;
+		for (const auto &marker : markers) {
+			const Point2f pos = marker + Point2f(3 * sin(phase), 3 * (1 - cos(phase)));
+			circle(img, Point(cvRound(pos.x * 16), cvRound(pos.y * 16)), 3 * 16, Scalar(255), FILLED, LINE_AA, 4);
+		}
+		GaussianBlur(img, images[frame], Size(5, 5), 1.0);
+	}
+	return images;
+}
+
+/**
+ * Write a rendered sequence as the videos and marker files of a sequence folder. Both cameras get the same images.
+ *
+ * \param[in] folder The sequence folder.
+ * \param[in] images The rendered images.
+ * \param[in] markers Marker positions in the first frame.
+ */
+static void writeSequence(const string &folder, const vector<Mat> &images, const vector<Point2f> &markers) {
+	for (const string &file : { Constants::sequence1File, Constants::sequence2File }) {
+		VideoWriter video(folder + file, VideoWriter::fourcc('M', 'J', 'P', 'G'), 25, images[0].size());
+		if (!video.isOpened()) {
+			throw "could not open video file " + folder + file + " for writing";
+		}
+		Mat color;
+		for (const auto &img : images) {
+			cvtColor(img, color, COLOR_GRAY2BGR);
+			video.write(color);
+		}
+	}
+	Mat markerData(static_cast<int>(markers.size()), 2, CV_64F);
+	for (int i = 0; i < markerData.rows; ++i) {
+		markerData.at<double>(i, 0) = markers[i].x;
+		markerData.at<double>(i, 1) = markers[i].y;
+	}
+	writeMatrix(folder + Constants::markers1File, markerData);
+	writeMatrix(folder + Constants::markers2File, markerData);
+}
+
+/**
+ * Create observations of random points in front of the cameras.
+ *
+ * \param[in] calib Calibration data.
+ * \param[in] numberOfMarkers Number of markers.
+ * \param[in] numberOfFrames Number of frames.
+ * \param[out] markers The observations in both cameras.
+ */
+static void createObservations(const Calibration &calib, unsigned int numberOfMarkers, unsigned int numberOfFrames, TrackBuffer markers[2]) {
+	RNG rng(42);
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		markers[camera] = TrackBuffer(numberOfFrames, numberOfMarkers);
+	}
+	for (unsigned int frame = 0; frame < numberOfFrames; ++frame) {
+		for (unsigned int marker = 0; marker < numberOfMarkers; ++marker) {
+			const Vec4d point(rng.uniform(-300.0, 300.0), rng.uniform(-200.0, 200.0), rng.uniform(1500.0, 2500.0), 1);
+			for (unsigned int camera = 0; camera < 2; ++camera) {
+				const Vec3d projected = calib.getProjectionMat(camera) * point;
+				markers[camera][frame][marker] = Point2f(static_cast<float>(projected[0] / projected[2] + rng.gaussian(0.3)), static_cast<float>(projected[1] / projected[2] + rng.gaussian(0.3)));
+			}
+		}
+	}
+}
+
+/**
+ * Parse a comma-separated list of numbers.
+ *
+ * \param[in] str The list.
+ * \returns The numbers.
+ */
+static vector<unsigned int> parseList(const string &str) {
+	vector<unsigned int> values;
+	istringstream s(str);
+	string value;
+	while (getline(s, value, ',')) {
+		values.push_back(stoul(value));
+	}
+	return values;
+}
+
+/**
+ * Parse a comma-separated list of frame sizes in the format <width>x<height>.
+ *
+ * \param[in] str The list.
+ * \returns The frame sizes.
+ */
+static vector<Size> parseSizes(const string &str) {
+	vector<Size> sizes;
+	istringstream s(str);
+	string value;
+	while (getline(s, value, ',')) {
+		const size_t separator = value.find('x');
+		if (separator == string::npos) {
+			throw "invalid frame size " + value;
+		}
+		sizes.push_back(Size(stoi(value.substr(0, separator)), stoi(value.substr(separator + 1))));
+	}
+	return sizes;
+}
+
+/**
+ * Sink for results of benchmarks, so the compiler cannot remove the measured computations.
+ */
+static volatile float benchmarkSink;
+
+int main(int argc, char **argv) {
+	try {
+		// get options from command line
+		BenchmarkOptions options;
+		for (int i = 1; i < argc; ++i) {
+			const string arg(argv[i]);
+			if (arg.compare(0, 9, "--output=") == 0) {
+				options.outputFile = arg.substr(9);
+			} else if (arg.compare(0, 7, "--work=") == 0) {
+				options.workFolder = arg.substr(7) + "/";
+			} else if (arg.compare(0, 14, "--calibration=") == 0) {
+				options.calibFolder = arg.substr(14) + "/";
+			} else if (arg.compare(0, 9, "--filter=") == 0) {
+				options.filter = arg.substr(9);
+			} else if (arg.compare(0, 11, "--min-time=") == 0) {
+				options.minTime = stod(arg.substr(11));
+			} else if (arg.compare(0, 18, "--min-repetitions=") == 0) {
+				options.minRepetitions = max(1ul, stoul(arg.substr(18)));
+			} else if (arg.compare(0, 14, "--frame-sizes=") == 0) {
+				options.frameSizes = parseSizes(arg.substr(14));
+			} else if (arg.compare(0, 10, "--markers=") == 0) {
+				options.markers = parseList(arg.substr(10));
+			} else if (arg.compare(0, 9, "--frames=") == 0) {
+				options.frames = parseList(arg.substr(9));
+			} else {
+				cerr << "Unknown option " << arg << endl;
+				cerr << "Options: --output=<file>          write the results as JSON to <file>, benchmark.json by default" << endl;
+				cerr << "         --work=<folder>          create the generated input and output files in <folder>" << endl;
+				cerr << "         --calibration=<folder>   use the calibration data in <folder> instead of synthetic calibration data" << endl;
+				cerr << "         --filter=<text>          only run the benchmarks whose name contains <text>" << endl;
+				cerr << "         --min-time=<seconds>     repeat each benchmark for at least <seconds>" << endl;
+				cerr << "         --min-repetitions=<n>    repeat each benchmark at least <n> times" << endl;
+				cerr << "         --frame-sizes=<list>     comma-separated frame sizes like 640x480" << endl;
+				cerr << "         --markers=<list>         comma-separated numbers of markers" << endl;
+				cerr << "         --frames=<list>          comma-separated numbers of frames" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		const auto isZero = [](unsigned int value) { return value == 0; };
+		if (options.frameSizes.empty() || options.markers.empty() || options.frames.empty() || any_of(options.markers.begin(), options.markers.end(), isZero) || any_of(options.frames.begin(), options.frames.end(), isZero)) {
+			cerr << "Frame sizes, numbers of markers and numbers of frames must not be empty or zero" << endl;
+			return EXIT_FAILURE;
+		}
+		setDisplay(Display::None);
+		BenchmarkRunner runner(options);
+
+		// use synthetic calibration data if no calibration data is given
+		if (options.calibFolder.empty()) {
+			options.calibFolder = options.workFolder + "calibration/";
+			createFolder(options.calibFolder);
+			Generator::writeCalibration(options.calibFolder, options.frameSizes[0]);
+		}
+		const Calibration calib(options.calibFolder);
+		const string sequenceFolder = options.workFolder + "sequence/";
+		createFolder(sequenceFolder);
+
+		// reading matrices, the size of the matrix corresponds to a result file
+		for (unsigned int numberOfMarkers : options.markers) {
+			for (unsigned int numberOfFrames : options.frames) {
+				const unsigned int rows = numberOfMarkers * numberOfFrames;
+				const string file = options.workFolder + "matrix.csv";
+				if (!runner.isSelected("read_matrix", { { "rows", rows } })) {
+					continue;
+				}
+				Mat mat(rows, 5, CV_64F);
+				randu(mat, -1000, 1000);
+				writeMatrix(file, mat);
+				runner.run("read_matrix", { { "rows", rows } }, rows, [&]() {
+					benchmarkSink = readMatrix(file).at<float>(0, 0);
+				});
+			}
+		}
+
+		// decoding and tracking of rendered sequences
+		for (const Size &frameSize : options.frameSizes) {
+			for (unsigned int numberOfFrames : options.frames) {
+				for (unsigned int numberOfMarkers : options.markers) {
+					const vector<Point2f> markers = createMarkerGrid(frameSize, numberOfMarkers);
+					const vector<pair<string, unsigned int>> parameters = { { "width", frameSize.width }, { "height", frameSize.height }, { "markers", numberOfMarkers }, { "frames", numberOfFrames } };
+					if (!runner.isSelected("sequence_load", parameters) && !runner.isSelected("tracking", parameters)) {
+						continue;
+					}
+					const vector<Mat> images = renderSequence(frameSize, markers, numberOfFrames);
+
+					// loading a sequence decodes both videos, undistorts the frames and refines the markers
+					if (runner.isSelected("sequence_load", parameters)) {
+						writeSequence(sequenceFolder, images, markers);
+						runner.run("sequence_load", parameters, numberOfFrames, [&]() {
+							Sequence sequence(sequenceFolder, calib);
+							benchmarkSink = static_cast<float>(sequence.getNumberOfFrames());
+						});
+					}
+
+					// tracking the markers through all frames of a camera
+					const Tracking track(calib);
+					runner.run("tracking", parameters, numberOfFrames, [&]() {
+						const TrackBuffer tracked = track(images, markers);
+						benchmarkSink = tracked.data()[0].x;
+					});
+				}
+			}
+		}
+
+		// triangulation, motion and writing of the result
+		for (unsigned int numberOfMarkers : options.markers) {
+			for (unsigned int numberOfFrames : options.frames) {
+				const vector<pair<string, unsigned int>> parameters = { { "markers", numberOfMarkers }, { "frames", numberOfFrames } };
+				const double positions = static_cast<double>(numberOfMarkers) * numberOfFrames;
+				TrackBuffer markers[2];
+				createObservations(calib, numberOfMarkers, numberOfFrames, markers);
+
+				const Triangulation triangOptimal(calib, Triangulation::Correction::Optimal);
+				const Triangulation triangSampson(calib, Triangulation::Correction::Sampson);
+				runner.run("triangulation_optimal", parameters, positions, [&]() {
+					benchmarkSink = triangOptimal(markers[0], markers[1]).data()[0].x;
+				});
+				runner.run("triangulation_sampson", parameters, positions, [&]() {
+					benchmarkSink = triangSampson(markers[0], markers[1]).data()[0].x;
+				});
+				runner.run("triangulation_motion", parameters, positions, [&]() {
+					PointCloudSequence motion;
+					triangOptimal(markers[0], markers[1], motion);
+					benchmarkSink = motion.data()[0].x;
+				});
+
+				const PointCloudSequence result = triangOptimal(markers[0], markers[1]);
+				runner.run("calculate_motion", parameters, positions, [&]() {
+					benchmarkSink = Triangulation::calculateMotion(result).data()[0].x;
+				});
+				runner.run("write_result_csv", parameters, positions, [&]() {
+					writeResult(options.workFolder + "result.csv", result);
+				});
+				runner.run("write_result_npy", parameters, positions, [&]() {
+					writeResult(options.workFolder + "result.npy", result);
+				});
+			}
+		}
+
+		// write all results
+		runner.writeJson(options.outputFile);
+		logMessage("wrote benchmark results to " + options.outputFile);
+		return EXIT_SUCCESS;
+	} catch (const string &err) {
+		// print error message and exit program with code for failure
+		cerr << err << endl;
+		return EXIT_FAILURE;
+	} catch (const char *err) {
+		cerr << err << endl;
+		return EXIT_FAILURE;
+	} catch (const exception &err) {
+		// e.g. invalid numbers in the options
+		cerr << err.what() << endl;
+		return EXIT_FAILURE;
+	}
+}
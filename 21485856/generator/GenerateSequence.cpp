@@ -0,0 +1,174 @@
+#include <opencv2/opencv.hpp>
+
+#include "tools.hpp"
+#include "Constants.hpp"
+#include "Calibration.hpp"
+#include "Triangulation.hpp"
+#include "Generator.hpp"
+#include <string>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <exception>
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+/**
+ * Compare a result file with the ground truth of a generated sequence. The result contains the motion of the markers,
+ * so it is compared with the motion calculated from the ground truth positions.
+ *
+ * \param[in] resultFile The result file in CSV format.
+ * \param[in] groundTruthFile The ground truth file of the sequence.
+ */
+static void evaluateResult(const string &resultFile, const string &groundTruthFile) {
+	const PointCloudSequence result = Generator::readTrajectories(resultFile);
+	const PointCloudSequence expected = Triangulation::calculateMotion(Generator::readTrajectories(groundTruthFile));
+	if ((result.getNumberOfFrames() != expected.getNumberOfFrames()) || (result.getNumberOfMarkers() != expected.getNumberOfMarkers())) {
+		throw "the result has " + to_string(result.getNumberOfFrames()) + " frames with " + to_string(result.getNumberOfMarkers()) + " markers, but the ground truth has "
+			+ to_string(expected.getNumberOfFrames()) + " frames with " + to_string(expected.getNumberOfMarkers()) + " markers";
+	}
+
+	// accumulate the deviations of all positions
+	double sum = 0, squaredSum = 0, maximum = 0;
+	for (unsigned int frame = 0; frame < result.getNumberOfFrames(); ++frame) {
+		for (unsigned int marker = 0; marker < result.getNumberOfMarkers(); ++marker) {
+			const double d = norm(result[frame][marker] - expected[frame][marker]);
+			sum += d;
+			squaredSum += d * d;
+			maximum = max(maximum, d);
+		}
+	}
+	const double count = static_cast<double>(result.getNumberOfFrames()) * result.getNumberOfMarkers();
+	logMessage("deviation from ground truth: mean " + to_string(sum / count) + ", root mean square " + to_string(sqrt(squaredSum / count)) + ", maximum " + to_string(maximum));
+}
+
+/**
+ * Parse a frame size in the format <width>x<height>.
+ *
+ * \param[in] str The frame size.
+ * \returns The frame size.
+ */
+static Size parseSize(const string &str) {
+	const size_t separator = str.find('x');
+	if (separator == string::npos) {
+		throw "invalid frame size " + str;
+	}
+	return Size(stoi(str.substr(0, separator)), stoi(str.substr(separator + 1)));
+}
+
+int main(int argc, char **argv) {
+	try {
+		// get options and the sequence folder from command line
+		Generator::Settings settings;
+		string sequenceFolder, calibFolder, trajectoryFile, cacheFile, resultFile;
+		bool frameSizeSelected = false;
+		for (int i = 1; i < argc; ++i) {
+			const string arg(argv[i]);
+			if (arg.compare(0, 14, "--calibration=") == 0) {
+				calibFolder = arg.substr(14) + "/";
+			} else if (arg.compare(0, 10, "--markers=") == 0) {
+				settings.numberOfMarkers = stoul(arg.substr(10));
+			} else if (arg.compare(0, 9, "--frames=") == 0) {
+				settings.numberOfFrames = stoul(arg.substr(9));
+			} else if (arg.compare(0, 13, "--frame-size=") == 0) {
+				settings.frameSize = parseSize(arg.substr(13));
+				frameSizeSelected = true;
+			} else if (arg == "--trajectory=static") {
+				settings.trajectory = Generator::Trajectory::Static;
+			} else if (arg == "--trajectory=circle") {
+				settings.trajectory = Generator::Trajectory::Circle;
+			} else if (arg == "--trajectory=wave") {
+				settings.trajectory = Generator::Trajectory::Wave;
+			} else if (arg.compare(0, 13, "--trajectory=") == 0) {
+				trajectoryFile = arg.substr(13);
+			} else if (arg.compare(0, 11, "--distance=") == 0) {
+				settings.distance = stof(arg.substr(11));
+			} else if (arg.compare(0, 12, "--amplitude=") == 0) {
+				settings.amplitude = stof(arg.substr(12));
+			} else if (arg.compare(0, 9, "--period=") == 0) {
+				settings.period = stof(arg.substr(9));
+			} else if (arg.compare(0, 9, "--radius=") == 0) {
+				settings.markerRadius = stof(arg.substr(9));
+			} else if (arg.compare(0, 8, "--noise=") == 0) {
+				settings.noise = stof(arg.substr(8));
+			} else if (arg.compare(0, 7, "--seed=") == 0) {
+				settings.seed = stoul(arg.substr(7));
+			} else if (arg.compare(0, 8, "--cache=") == 0) {
+				cacheFile = arg.substr(8);
+			} else if (arg.compare(0, 11, "--evaluate=") == 0) {
+				resultFile = arg.substr(11);
+			} else if ((arg.compare(0, 2, "--") != 0) && sequenceFolder.empty()) {
+				sequenceFolder = arg + "/";
+			} else {
+				sequenceFolder.clear();
+				cerr << "Unknown option " << arg << endl;
+				break;
+			}
+		}
+		if (sequenceFolder.empty()) {
+			cerr << "Please specify the folder for the generated sequence" << endl;
+			cerr << "Options: --calibration=<folder>   render with the calibration data in <folder>, otherwise synthetic calibration data is written into the calibration folder of the sequence" << endl;
+			cerr << "         --markers=<n>            number of markers, 100 by default" << endl;
+			cerr << "         --frames=<n>             number of frames, 100 by default" << endl;
+			cerr << "         --frame-size=<w>x<h>     size of the images, by default twice the principal point of the first camera or 640x480 with synthetic calibration data" << endl;
+			cerr << "         --trajectory=<kind>      static, circle or wave trajectories, or a file with trajectories in the format of the result file" << endl;
+			cerr << "         --distance=<d>           mean distance of the markers from the first camera, 2000 by default" << endl;
+			cerr << "         --amplitude=<a>          amplitude of the motion of the markers, 10 by default" << endl;
+			cerr << "         --period=<n>             number of frames of a period of the motion, 50 by default" << endl;
+			cerr << "         --radius=<r>             radius of the markers in pixels, 3 by default" << endl;
+			cerr << "         --noise=<sigma>          standard deviation of the image noise in gray values, 2 by default" << endl;
+			cerr << "         --seed=<n>               seed of the random numbers" << endl;
+			cerr << "         --cache=<file>           also write the undistorted images into the frame cache <file>" << endl;
+			cerr << "         --evaluate=<file>        compare the result file <file> of the generated sequence with its ground truth and exit" << endl;
+			return EXIT_FAILURE;
+		}
+		setDisplay(Display::None);
+
+		// compare a result with the ground truth if requested
+		if (!resultFile.empty()) {
+			evaluateResult(resultFile, sequenceFolder + Constants::groundTruthFile);
+			return EXIT_SUCCESS;
+		}
+
+		// write synthetic calibration data if no calibration data is given
+		createFolder(sequenceFolder);
+		if (calibFolder.empty()) {
+			calibFolder = sequenceFolder + "calibration/";
+			createFolder(calibFolder);
+			Generator::writeCalibration(calibFolder, settings.frameSize);
+			logMessage("wrote synthetic calibration data to " + calibFolder);
+		}
+		const Calibration calib(calibFolder);
+
+		// the principal point is usually close to the center of the images
+		if (!frameSizeSelected) {
+			const Matx33d K(calib.getCamera1());
+			settings.frameSize = Size(cvRound(2 * K(0, 2)), cvRound(2 * K(1, 2)));
+		}
+
+		// create or read the trajectories
+		const Generator generator(calib, settings);
+		const PointCloudSequence trajectories = trajectoryFile.empty() ? generator.createTrajectories() : Generator::readTrajectories(trajectoryFile);
+		logMessage("generate sequence with " + to_string(trajectories.getNumberOfFrames()) + " frames of " + to_string(settings.frameSize.width) + "x" + to_string(settings.frameSize.height)
+			+ " pixels and " + to_string(trajectories.getNumberOfMarkers()) + " markers in " + sequenceFolder);
+
+		// and render them
+		generator(sequenceFolder, trajectories, cacheFile);
+		logMessage("finished generating sequence");
+
+		return EXIT_SUCCESS;
+	} catch (const string &err) {
+		// print error message and exit program with code for failure
+		cerr << err << endl;
+		return EXIT_FAILURE;
+	} catch (const char *err) {
+		cerr << err << endl;
+		return EXIT_FAILURE;
+	} catch (const exception &err) {
+		// e.g. invalid numbers in the options
+		cerr << err.what() << endl;
+		return EXIT_FAILURE;
+	}
+}
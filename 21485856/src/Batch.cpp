@@ -0,0 +1,248 @@
+#include "Batch.hpp"
+
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <exception>
+
+#include "Sequence.hpp"
+#include "tools.hpp"
+#include "Profiler.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+namespace {
+	/**
+	 * Remove leading and trailing blanks of a string.
+	 *
+	 * \param[in] str The string.
+	 * \returns The string without leading and trailing blanks.
+	 */
+	string trim(const string &str) {
+		const size_t first = str.find_first_not_of(" \t\r");
+		if (first == string::npos) {
+			return string();
+		}
+		const size_t last = str.find_last_not_of(" \t\r");
+		return str.substr(first, last - first + 1);
+	}
+}
+
+struct Batch::Run {
+	/**
+	 * Constructor.
+	 *
+	 * \param[in] entries The sequences to process.
+	 */
+	Run(const vector<Entry> &entries) : entries(entries), nextEntry(0), failedSequences(0), frames(0) {
+	}
+
+	/**
+	 * The sequences to process.
+	 */
+	const vector<Entry> &entries;
+
+	/**
+	 * Index of the next sequence to load.
+	 */
+	atomic<size_t> nextEntry;
+
+	/**
+	 * Counter of the failed sequences.
+	 */
+	atomic<unsigned int> failedSequences;
+
+	/**
+	 * Counter of the processed frames.
+	 */
+	atomic<unsigned long long> frames;
+};
+
+struct Batch::Job {
+	/**
+	 * Constructor.
+	 *
+	 * \param[in] entry The sequence to process.
+	 * \param[in,out] run The state of the batch run.
+	 */
+	Job(const Entry &entry, Run &run) : entry(entry), remainingCameras(2), failed(false), start(chrono::steady_clock::now()), run(run) {
+	}
+
+	/**
+	 * The sequence to process.
+	 */
+	const Entry entry;
+
+	/**
+	 * The loaded sequence. It is released as soon as the markers have been tracked.
+	 */
+	unique_ptr<Sequence> sequence;
+
+	/**
+	 * The tracked marker positions of both cameras.
+	 */
+	TrackBuffer markers[2];
+
+	/**
+	 * Number of cameras that have not been tracked yet.
+	 */
+	atomic<unsigned int> remainingCameras;
+
+	/**
+	 * Flag indicating that a task of the sequence failed.
+	 */
+	atomic<bool> failed;
+
+	/**
+	 * Start time of the processing of the sequence.
+	 */
+	chrono::steady_clock::time_point start;
+
+	/**
+	 * The state of the batch run.
+	 */
+	Run &run;
+};
+
+Batch::Batch(const Calibration &c, const Tracking &track, const Triangulation &triang, bool undistortImages, int precision) : calib(c), track(track), triang(triang), undistortImages(undistortImages), precision(precision) {
+}
+
+vector<Batch::Entry> Batch::readManifest(const string &file, const string &outputFolder) {
+	// open manifest
+	ifstream f(file);
+	if (!f.is_open()) {
+		throw "could not open manifest file " + file + ".";
+	}
+
+	// read one sequence per line
+	vector<Entry> entries;
+	string line;
+	for (unsigned int lineIdx = 1; getline(f, line); ++lineIdx) {
+		line = trim(line);
+		if (line.empty() || (line[0] == '#')) {
+			continue;
+		}
+
+		// split line into sequence folder and output file
+		const size_t separator = line.find(Constants::SeparatorChar);
+		Entry entry;
+		if (separator != string::npos) {
+			entry.sequenceFolder = trim(line.substr(0, separator));
+			entry.outputFile = trim(line.substr(separator + 1));
+		}
+		if (entry.sequenceFolder.empty() || entry.outputFile.empty()) {
+			throw "line " + to_string(lineIdx) + " of manifest " + file + " does not contain a sequence folder and an output file.";
+		}
+		entry.sequenceFolder += "/";
+		entry.outputFile = outputFolder + entry.outputFile;
+		entries.push_back(entry);
+	}
+
+	// check for an empty manifest
+	if (entries.empty()) {
+		throw "manifest " + file + " does not contain any sequence.";
+	}
+	return entries;
+}
+
+template<typename F> void Batch::submit(const shared_ptr<Job> &job, ThreadPool &pool, F task) const {
+	pool.submit([this, job, task, &pool]() {
+		// report only the first failure of a sequence, its following tasks are not submitted, so the next sequence is loaded instead
+		auto fail = [this, &job, &pool](const string &err) {
+			if (!job->failed.exchange(true)) {
+				++job->run.failedSequences;
+				logMessage("failed sequence " + job->entry.sequenceFolder + ": " + err);
+				loadNext(job->run, pool);
+			}
+		};
+
+		try {
+			task();
+		} catch (const string &err) {
+			fail(err);
+		} catch (const char *err) {
+			fail(err);
+		} catch (const exception &err) {
+			fail(err.what());
+		}
+	});
+}
+
+Batch::Summary Batch::operator()(const vector<Entry> &entries, ThreadPool &pool) const {
+	Run run(entries);
+	const auto start = chrono::steady_clock::now();
+
+	// start loading the first sequences, each sequence submits its following tasks and finally the loading of the next sequence itself,
+	// two threads track a loaded sequence while the next one is loaded
+	const unsigned int loadedSequences = (pool.getNumberOfThreads() + 1) / 2 + 1;
+	for (unsigned int i = 0; i < loadedSequences; ++i) {
+		loadNext(run, pool);
+	}
+	pool.wait();
+
+	// and summarize the run
+	Summary summary = Summary();
+	summary.sequences = static_cast<unsigned int>(entries.size());
+	summary.failedSequences = run.failedSequences;
+	summary.frames = run.frames;
+	summary.time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return summary;
+}
+
+void Batch::loadNext(Run &run, ThreadPool &pool) const {
+	// every sequence is loaded once
+	const size_t index = run.nextEntry++;
+	if (index >= run.entries.size()) {
+		return;
+	}
+	const auto job = make_shared<Job>(run.entries[index], run);
+	submit(job, pool, [this, job, &pool]() { load(job, pool); });
+}
+
+void Batch::load(const shared_ptr<Job> &job, ThreadPool &pool) const {
+	// load the whole sequence
+	PROFILE_SCOPE("load sequence");
+	job->start = chrono::steady_clock::now();
+	job->sequence.reset(new Sequence(job->entry.sequenceFolder, calib, 0, undistortImages));
+
+	// and track both cameras in separate tasks
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		submit(job, pool, [this, job, camera, &pool]() { trackCamera(job, camera, pool); });
+	}
+}
+
+void Batch::trackCamera(const shared_ptr<Job> &job, unsigned int camera, ThreadPool &pool) const {
+	// track the markers and undistort them if the images are not undistorted
+	PROFILE_SCOPE("track camera");
+	const Sequence &sequence = *job->sequence;
+	job->markers[camera] = track(sequence[camera], sequence.getMarkers(camera));
+	if (!undistortImages) {
+		calib.undistortPoints(camera, job->markers[camera]);
+	}
+
+	// the camera finishing last submits the triangulation
+	if (--job->remainingCameras == 0) {
+		submit(job, pool, [this, job, &pool]() { finish(job, pool); });
+	}
+}
+
+void Batch::finish(const shared_ptr<Job> &job, ThreadPool &pool) const {
+	// the images are not needed any more
+	PROFILE_SCOPE("finish sequence");
+	job->sequence.reset();
+
+	// triangulate and calculate the motion in a single pass and write it
+	PointCloudSequence motion;
+	triang(job->markers[0], job->markers[1], motion);
+	writeResult(job->entry.outputFile, motion, precision);
+
+	// report the sequence
+	job->run.frames += motion.getNumberOfFrames();
+	const double time = chrono::duration<double>(chrono::steady_clock::now() - job->start).count();
+	logMessage("finished sequence " + job->entry.sequenceFolder + " with " + to_string(motion.getNumberOfFrames()) + " frames in " + to_string(time) + " s");
+
+	// and continue with the next sequence
+	loadNext(job->run, pool);
+}
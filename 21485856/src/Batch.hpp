@@ -0,0 +1,178 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "Calibration.hpp"
+#include "Tracking.hpp"
+#include "Triangulation.hpp"
+#include "ThreadPool.hpp"
+#include "Constants.hpp"
+
+namespace CVLab {
+	/**
+	 * Runner for processing many sequences recorded with the same calibration. Each sequence is split into tasks for
+	 * loading, tracking of each camera and triangulation with writing of the result, and the tasks of all sequences
+	 * are executed by a work-stealing thread pool. A task submits the following tasks of its sequence when it is done,
+	 * so no thread blocks waiting for another one. Only a few sequences are loaded at the same time, each finished sequence
+	 * starts loading the next one, so the memory does not grow with the number of threads. A failing sequence is reported
+	 * and does not stop the others. Each camera is tracked by a single task, so the tracking must not be chunked.
+	 */
+	class Batch {
+	public:
+		/**
+		 * A sequence to process.
+		 */
+		struct Entry {
+			/**
+			 * The folder containing the videos and markers of the sequence.
+			 */
+			std::string sequenceFolder;
+
+			/**
+			 * The file to save the motion of the markers to.
+			 */
+			std::string outputFile;
+		};
+
+		/**
+		 * Summary of a batch run.
+		 */
+		struct Summary {
+			/**
+			 * Number of sequences.
+			 */
+			unsigned int sequences;
+
+			/**
+			 * Number of sequences that could not be processed.
+			 */
+			unsigned int failedSequences;
+
+			/**
+			 * Number of frames of all processed sequences.
+			 */
+			unsigned long long frames;
+
+			/**
+			 * Time in seconds for processing all sequences.
+			 */
+			double time;
+		};
+
+		/**
+		 * Constructor.
+		 *
+		 * \param[in] c Calibration data shared by all sequences.
+		 * \param[in] track The tracking functor.
+		 * \param[in] triang The triangulation functor.
+		 * \param[in] undistortImages Flag indicating whether the images are undistorted. Otherwise only the tracked positions are undistorted.
+		 * \param[in] precision Number of decimal places of the coordinates in CSV files.
+		 */
+		Batch(const Calibration &c, const Tracking &track, const Triangulation &triang, bool undistortImages = true, int precision = Constants::resultPrecision);
+
+		/**
+		 * Read a manifest of sequences. Each line contains a sequence folder and an output file separated by
+		 * Constants::SeparatorChar. Empty lines and lines starting with # are ignored.
+		 *
+		 * \param[in] file The manifest file.
+		 * \param[in] outputFolder The folder the output files are relative to.
+		 * \returns The sequences to process.
+		 */
+		static std::vector<Entry> readManifest(const std::string &file, const std::string &outputFolder);
+
+		/**
+		 * Process all sequences.
+		 *
+		 * \param[in] entries The sequences to process.
+		 * \param[in] pool The thread pool executing the tasks.
+		 * \returns Summary of the run.
+		 */
+		Summary operator()(const std::vector<Entry> &entries, ThreadPool &pool) const;
+
+	private:
+		/**
+		 * State of a batch run shared by all sequences.
+		 */
+		struct Run;
+
+		/**
+		 * State of a sequence while it is processed.
+		 */
+		struct Job;
+
+		/**
+		 * Assignment operator. It is disabled as it is not possible to assign constant values.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		Batch & operator=(const Batch &other);
+
+		/**
+		 * Submit the loading of the next sequence which has not been started yet, if there is one.
+		 *
+		 * \param[in,out] run The state of the batch run.
+		 * \param[in] pool The thread pool executing the tasks.
+		 */
+		void loadNext(Run &run, ThreadPool &pool) const;
+
+		/**
+		 * Load a sequence and submit the tracking of both cameras.
+		 *
+		 * \param[in] job The sequence.
+		 * \param[in] pool The thread pool executing the tasks.
+		 */
+		void load(const std::shared_ptr<Job> &job, ThreadPool &pool) const;
+
+		/**
+		 * Track the markers of a camera and submit the triangulation when both cameras are done.
+		 *
+		 * \param[in] job The sequence.
+		 * \param[in] camera Index of the camera.
+		 * \param[in] pool The thread pool executing the tasks.
+		 */
+		void trackCamera(const std::shared_ptr<Job> &job, unsigned int camera, ThreadPool &pool) const;
+
+		/**
+		 * Triangulate the markers, calculate their motion and write it to the output file, then submit the loading of the next sequence.
+		 *
+		 * \param[in] job The sequence.
+		 * \param[in] pool The thread pool executing the tasks.
+		 */
+		void finish(const std::shared_ptr<Job> &job, ThreadPool &pool) const;
+
+		/**
+		 * Submit a task of a sequence. If it fails, the failure of the sequence is reported and the next sequence is loaded.
+		 *
+		 * \param[in] job The sequence.
+		 * \param[in] pool The thread pool executing the tasks.
+		 * \param[in] task The task.
+		 */
+		template<typename F> void submit(const std::shared_ptr<Job> &job, ThreadPool &pool, F task) const;
+
+		/**
+		 * Calibration data shared by all sequences.
+		 */
+		const Calibration &calib;
+
+		/**
+		 * The tracking functor.
+		 */
+		const Tracking &track;
+
+		/**
+		 * The triangulation functor.
+		 */
+		const Triangulation &triang;
+
+		/**
+		 * Flag indicating whether the images are undistorted.
+		 */
+		const bool undistortImages;
+
+		/**
+		 * Number of decimal places of the coordinates in CSV files.
+		 */
+		const int precision;
+	};
+}
\ No newline at end of file
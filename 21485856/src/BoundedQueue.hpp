@@ -0,0 +1,190 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+namespace CVLab {
+	/**
+	 * Queue with a fixed capacity for passing items between threads. Pushing blocks while the queue is full and
+	 * popping blocks while it is empty, so a fast producer cannot run ahead of a slow consumer by more than the
+	 * capacity. The producer closes the queue after the last item, and any thread can abort it to stop both sides.
+	 * The depth of the queue is recorded on every push, so congestion can be observed while it is used.
+	 */
+	template<typename T> class BoundedQueue {
+	public:
+		/**
+		 * Constructor.
+		 *
+		 * \param[in] capacity Maximum number of items in the queue.
+		 */
+		explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)), closed(false), aborted(false), pushes(0), depthSum(0), maxDepth(0) {
+		}
+
+		/**
+		 * Append an item. Waits while the queue is full.
+		 *
+		 * \param[in] item The item to append.
+		 * \returns False if the queue has been aborted.
+		 */
+		bool push(T item) {
+			std::unique_lock<std::mutex> lock(mutex);
+			notFull.wait(lock, [this]() { return (items.size() < capacity) || aborted; });
+			if (aborted) {
+				return false;
+			}
+			items.push_back(std::move(item));
+
+			// record the depth seen by the new item
+			++pushes;
+			depthSum += items.size();
+			maxDepth = std::max(maxDepth, items.size());
+
+			notEmpty.notify_one();
+			return true;
+		}
+
+		/**
+		 * Remove the oldest item. Waits while the queue is empty and has not been closed.
+		 *
+		 * \param[out] item The removed item.
+		 * \returns False if the queue has been closed and all items have been removed, or if it has been aborted.
+		 */
+		bool pop(T &item) {
+			std::unique_lock<std::mutex> lock(mutex);
+			notEmpty.wait(lock, [this]() { return !items.empty() || closed || aborted; });
+			if (aborted || items.empty()) {
+				return false;
+			}
+			item = std::move(items.front());
+			items.pop_front();
+
+			notFull.notify_one();
+			return true;
+		}
+
+		/**
+		 * Signal that no more items will be appended. The remaining items can still be removed.
+		 */
+		void close() {
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			notEmpty.notify_all();
+		}
+
+		/**
+		 * Stop the queue. All waiting and following calls of push and pop return false.
+		 */
+		void abort() {
+			std::lock_guard<std::mutex> lock(mutex);
+			aborted = true;
+			notEmpty.notify_all();
+			notFull.notify_all();
+		}
+
+		/**
+		 * Get the maximum number of items in the queue.
+		 *
+		 * \returns The capacity.
+		 */
+		size_t getCapacity() const {
+			return capacity;
+		}
+
+		/**
+		 * Get the current number of items in the queue.
+		 *
+		 * \returns The number of items.
+		 */
+		size_t size() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return items.size();
+		}
+
+		/**
+		 * Get the largest number of items that have been in the queue.
+		 *
+		 * \returns The maximum depth.
+		 */
+		size_t getMaxDepth() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return maxDepth;
+		}
+
+		/**
+		 * Get the average number of items in the queue when an item was appended.
+		 *
+		 * \returns The average depth.
+		 */
+		double getAverageDepth() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return (pushes == 0) ? 0.0 : static_cast<double>(depthSum) / pushes;
+		}
+
+	private:
+		/**
+		 * Copy constructor. It is disabled as waiting threads cannot be shared.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		BoundedQueue(const BoundedQueue &other);
+
+		/**
+		 * Assignment operator. It is disabled as waiting threads cannot be shared.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		BoundedQueue & operator=(const BoundedQueue &other);
+
+		/**
+		 * Maximum number of items in the queue.
+		 */
+		const size_t capacity;
+
+		/**
+		 * The items in the order they have been appended.
+		 */
+		std::deque<T> items;
+
+		/**
+		 * Flag indicating that no more items will be appended.
+		 */
+		bool closed;
+
+		/**
+		 * Flag indicating that the queue has been stopped.
+		 */
+		bool aborted;
+
+		/**
+		 * Number of appended items.
+		 */
+		size_t pushes;
+
+		/**
+		 * Sum of the depths seen by all appended items.
+		 */
+		size_t depthSum;
+
+		/**
+		 * Largest number of items that have been in the queue.
+		 */
+		size_t maxDepth;
+
+		/**
+		 * Mutex protecting all members.
+		 */
+		mutable std::mutex mutex;
+
+		/**
+		 * Condition for waiting until the queue is not full any more.
+		 */
+		std::condition_variable notFull;
+
+		/**
+		 * Condition for waiting until the queue is not empty any more.
+		 */
+		std::condition_variable notEmpty;
+	};
+}
\ No newline at end of file
@@ -1,62 +1,373 @@
-#include "Calibration.hpp"
-
-#include "tools.hpp"
-#include "Constants.hpp"
-
-using namespace CVLab;
-using namespace cv;
-using namespace std;
-
-Calibration::Calibration(const string &folder) : camera1(readMatrix(folder + Constants::camera1File)),
-	                                         camera2(readMatrix(folder + Constants::camera2File)),
-						 distortion1(readMatrix(folder + Constants::distortion1File)),
-					         distortion2(readMatrix(folder + Constants::distortion2File)),
-					         fundamentalMat(readMatrix(folder + Constants::fundamentalMatFile)),
-						 transCamera1World(readMatrix(folder + Constants::extCamera1WorldFile)),
-						 transCamera1Camera2(readMatrix(folder + Constants::extCamera1Camera2File)) {
-	// check validity of matrix dimensions
-	checkMatrixDimensions(camera1, 3, 3, "intrinsics of first camera");
-	checkMatrixDimensions(camera2, 3, 3, "intrinsics of second camera");
-	checkMatrixDimensions(distortion1, 1, 5, "distortion coefficient of first camera");
-	checkMatrixDimensions(distortion2, 1, 5, "distortion coefficient of second camera");
-	checkMatrixDimensions(fundamentalMat, 3, 3, "fundamental matrix");
-	checkMatrixDimensions(transCamera1World, 3, 4, "transformation from first camera to world corrdinate system");
-	checkMatrixDimensions(transCamera1Camera2, 3, 4, "transformation from first camera to second camera");
-}
-
-Calibration::Calibration(const Calibration &other) : camera1(other.camera1.clone()),
-	                                             camera2(other.camera2.clone()),
-						     distortion1(other.distortion1.clone()),
-						     distortion2(other.distortion2.clone()),
-						     fundamentalMat(other.fundamentalMat.clone()),
-						     transCamera1World(other.transCamera1World.clone()),
-						     transCamera1Camera2(other.transCamera1Camera2.clone()) {
-}
-
-Mat Calibration::getCamera1() const {
-	return camera1.clone();
-}
-
-Mat Calibration::getCamera2() const {
-	return camera2.clone();
-}
-
-Mat Calibration::getDistortion1() const {
-	return distortion1.clone();
-}
-
-Mat Calibration::getDistortion2() const {
-	return distortion2.clone();
-}
-
-Mat Calibration::getFundamentalMat() const {
-	return fundamentalMat.clone();
-}
-
-Mat Calibration::getTransCamera1World() const {
-	return transCamera1World.clone();
-}
-
-Mat Calibration::getTransCamera1Camera2() const {
-	return transCamera1Camera2.clone();
-}
+#include "Calibration.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+
+#include "tools.hpp"
+#include "Constants.hpp"
+#include "MappedFile.hpp"
+#include "Profiler.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+namespace {
+	/**
+	 * Number of CSV files with calibration data.
+	 */
+	const unsigned int numberOfCalibrationFiles = 7;
+
+	/**
+	 * Names of the CSV files in the order of the matrices in the bundle.
+	 */
+	const string *const calibrationFiles[numberOfCalibrationFiles] = { &Constants::camera1File, &Constants::camera2File, &Constants::distortion1File, &Constants::distortion2File, &Constants::fundamentalMatFile, &Constants::extCamera1WorldFile, &Constants::extCamera1Camera2File };
+
+	/**
+	 * Header at the beginning of a calibration bundle. It is followed by the matrices, each stored as number of rows
+	 * and columns and the values as 32 bit floats in row-major order. The sizes and modification times of the CSV
+	 * files the bundle was written from are stored, so that the bundle is not used once one of them has changed.
+	 */
+	struct BundleHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t numberOfMatrices;
+		uint64_t payloadSize;
+		uint64_t checksum;
+		uint64_t fileSizes[numberOfCalibrationFiles];
+		int64_t modificationTimes[numberOfCalibrationFiles];
+	};
+
+	/**
+	 * Identification of a calibration bundle.
+	 */
+	const char bundleMagic[8] = { '3', 'D', 'C', 'V', 'C', 'A', 'L', '\0' };
+
+	/**
+	 * Version of the calibration bundle format.
+	 */
+	const uint32_t bundleVersion = 2;
+}
+
+Calibration::Data::Data(const string &folder) : loadedFromBundle(false) {
+	// load the matrices from the bundle if possible and from the CSV files otherwise
+	loadedFromBundle = readBundle(folder);
+	if (!loadedFromBundle) {
+		readFiles(folder);
+	}
+
+	// check validity of matrix dimensions
+	checkMatrixDimensions(camera1, 3, 3, "intrinsics of first camera");
+	checkMatrixDimensions(camera2, 3, 3, "intrinsics of second camera");
+	checkMatrixDimensions(distortion1, 1, 5, "distortion coefficient of first camera");
+	checkMatrixDimensions(distortion2, 1, 5, "distortion coefficient of second camera");
+	checkMatrixDimensions(fundamentalMat, 3, 3, "fundamental matrix");
+	checkMatrixDimensions(transCamera1World, 3, 4, "transformation from first camera to world corrdinate system");
+	checkMatrixDimensions(transCamera1Camera2, 3, 4, "transformation from first camera to second camera");
+
+	// compute the derived quantities
+	fundamentalMatx = Matx33d(fundamentalMat);
+	projectionMat[0] = Matx33d(camera1) * Matx34d::eye();
+	projectionMat[1] = Matx33d(camera2) * Matx34d(transCamera1Camera2);
+	inverseCamera[0] = Matx33d(camera1).inv();
+	inverseCamera[1] = Matx33d(camera2).inv();
+	const Matx34d trans(transCamera1World);
+	transCamera1WorldHomogeneous = Matx44d::eye();
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 4; ++col) {
+			transCamera1WorldHomogeneous(row, col) = trans(row, col);
+		}
+	}
+
+	// combine the dimensions and values of all matrices into the hash value
+	hash = hashData(nullptr, 0);
+	for (const Mat *mat : { &camera1, &camera2, &distortion1, &distortion2, &fundamentalMat, &transCamera1World, &transCamera1Camera2 }) {
+		const int dims[2] = { mat->rows, mat->cols };
+		hash = hashData(dims, sizeof(dims), hash);
+		for (int row = 0; row < mat->rows; ++row) {
+			hash = hashData(mat->ptr(row), mat->cols * mat->elemSize(), hash);
+		}
+	}
+}
+
+bool Calibration::Data::readBundle(const string &folder) {
+	// map the file, the CSV files are used if this fails
+	const string file = folder + Constants::calibrationBundleFile;
+	unique_ptr<MappedFile> mapped;
+	try {
+		mapped.reset(new MappedFile(file));
+	} catch (const string &) {
+		return false;
+	}
+
+	// check the header
+	if (mapped->getSize() < sizeof(BundleHeader)) {
+		return false;
+	}
+	BundleHeader header;
+	memcpy(&header, mapped->getData(), sizeof(BundleHeader));
+	if ((memcmp(header.magic, bundleMagic, sizeof(bundleMagic)) != 0) || (header.version != bundleVersion) || (header.numberOfMatrices != numberOfCalibrationFiles)) {
+		return false;
+	}
+
+	// check that the existing CSV files have not been changed since the bundle was written
+	for (unsigned int i = 0; i < numberOfCalibrationFiles; ++i) {
+		uint64_t size;
+		int64_t modificationTime;
+		if (getFileStatus(folder + *calibrationFiles[i], size, modificationTime) && ((size != header.fileSizes[i]) || (modificationTime != header.modificationTimes[i]))) {
+			return false;
+		}
+	}
+
+	// check size and checksum of the matrix data
+	const char *payload = mapped->getData() + sizeof(BundleHeader);
+	if ((header.payloadSize != mapped->getSize() - sizeof(BundleHeader)) || (header.checksum != hashData(payload, static_cast<size_t>(header.payloadSize)))) {
+		return false;
+	}
+
+	// read the matrices in the order of the CSV files
+	Mat *matrices[numberOfCalibrationFiles] = { &camera1, &camera2, &distortion1, &distortion2, &fundamentalMat, &transCamera1World, &transCamera1Camera2 };
+	const char *end = payload + header.payloadSize;
+	for (Mat *mat : matrices) {
+		int32_t dims[2];
+		if (end - payload < static_cast<ptrdiff_t>(sizeof(dims))) {
+			return false;
+		}
+		memcpy(dims, payload, sizeof(dims));
+		payload += sizeof(dims);
+		const size_t size = static_cast<size_t>(max(dims[0], 0)) * static_cast<size_t>(max(dims[1], 0)) * sizeof(float);
+		if ((dims[0] <= 0) || (dims[1] <= 0) || (static_cast<size_t>(end - payload) < size)) {
+			return false;
+		}
+		*mat = Mat(dims[0], dims[1], CV_32F);
+		memcpy(mat->data, payload, size);
+		payload += size;
+	}
+	return payload == end;
+}
+
+void Calibration::Data::readFiles(const string &folder) {
+	camera1 = readMatrix(folder + Constants::camera1File);
+	camera2 = readMatrix(folder + Constants::camera2File);
+	distortion1 = readMatrix(folder + Constants::distortion1File);
+	distortion2 = readMatrix(folder + Constants::distortion2File);
+	fundamentalMat = readMatrix(folder + Constants::fundamentalMatFile);
+	transCamera1World = readMatrix(folder + Constants::extCamera1WorldFile);
+	transCamera1Camera2 = readMatrix(folder + Constants::extCamera1Camera2File);
+}
+
+Calibration::Calibration(const string &folder) : data(make_shared<const Data>(folder)) {
+}
+
+Calibration::Calibration(const Calibration &other) : data(other.data) {
+}
+
+void Calibration::writeBundle(const string &file) const {
+	// serialize the matrices in the order of the CSV files
+	const Mat *matrices[numberOfCalibrationFiles] = { &data->camera1, &data->camera2, &data->distortion1, &data->distortion2, &data->fundamentalMat, &data->transCamera1World, &data->transCamera1Camera2 };
+	vector<char> payload;
+	for (const Mat *mat : matrices) {
+		Mat values;
+		mat->convertTo(values, CV_32F);
+		const int32_t dims[2] = { values.rows, values.cols };
+		payload.insert(payload.end(), reinterpret_cast<const char *>(dims), reinterpret_cast<const char *>(dims) + sizeof(dims));
+		for (int row = 0; row < values.rows; ++row) {
+			const char *rowData = reinterpret_cast<const char *>(values.ptr(row));
+			payload.insert(payload.end(), rowData, rowData + values.cols * sizeof(float));
+		}
+	}
+
+	// create header
+	BundleHeader header;
+	memset(&header, 0, sizeof(BundleHeader));
+	memcpy(header.magic, bundleMagic, sizeof(bundleMagic));
+	header.version = bundleVersion;
+	header.numberOfMatrices = numberOfCalibrationFiles;
+	header.payloadSize = payload.size();
+	header.checksum = hashData(payload.data(), payload.size());
+
+	// record the state of the CSV files in the folder of the bundle
+	const string folder = file.substr(0, file.find_last_of("/\\") + 1);
+	for (unsigned int i = 0; i < numberOfCalibrationFiles; ++i) {
+		getFileStatus(folder + *calibrationFiles[i], header.fileSizes[i], header.modificationTimes[i]);
+	}
+
+	// write the bundle into a temporary file, renaming it replaces an existing bundle atomically
+	const string tempFile = file + ".tmp";
+	{
+		ofstream output(tempFile, ios_base::out | ios_base::trunc | ios_base::binary);
+		if (!output.is_open()) {
+			throw "could not open file " + tempFile + " for writing calibration bundle.";
+		}
+		output.write(reinterpret_cast<const char *>(&header), sizeof(BundleHeader));
+		output.write(payload.data(), payload.size());
+		output.close();
+		if (output.fail()) {
+			remove(tempFile.c_str());
+			throw "could not write calibration bundle " + tempFile;
+		}
+	}
+	if (rename(tempFile.c_str(), file.c_str()) != 0) {
+		remove(tempFile.c_str());
+		throw "could not rename " + tempFile + " to " + file;
+	}
+}
+
+bool Calibration::isLoadedFromBundle() const {
+	return data->loadedFromBundle;
+}
+
+const Mat & Calibration::getCamera1() const {
+	return data->camera1;
+}
+
+const Mat & Calibration::getCamera2() const {
+	return data->camera2;
+}
+
+const Mat & Calibration::getDistortion1() const {
+	return data->distortion1;
+}
+
+const Mat & Calibration::getDistortion2() const {
+	return data->distortion2;
+}
+
+const Mat & Calibration::getFundamentalMat() const {
+	return data->fundamentalMat;
+}
+
+const Mat & Calibration::getTransCamera1World() const {
+	return data->transCamera1World;
+}
+
+const Mat & Calibration::getTransCamera1Camera2() const {
+	return data->transCamera1Camera2;
+}
+
+const Matx33d & Calibration::getFundamentalMatx() const {
+	return data->fundamentalMatx;
+}
+
+const Matx34d & Calibration::getProjectionMat(unsigned int camera) const {
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+	return data->projectionMat[camera];
+}
+
+const Matx33d & Calibration::getInverseCamera(unsigned int camera) const {
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+	return data->inverseCamera[camera];
+}
+
+const Matx44d & Calibration::getTransCamera1WorldHomogeneous() const {
+	return data->transCamera1WorldHomogeneous;
+}
+
+uint64_t Calibration::getHash() const {
+	return data->hash;
+}
+
+void Calibration::undistortImage(unsigned int camera, const Mat &src, Mat &dst) const {
+	PROFILE_SCOPE("undistort image");
+
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+
+	// get remap tables and compute them if they do not exist for the size of the image yet
+	Mat map1, map2;
+	{
+		lock_guard<mutex> lock(data->undistortMapMutex);
+		if (data->undistortMap1[camera].empty() || (data->undistortMapSize[camera] != src.size())) {
+			const Mat &K = (camera == 0) ? data->camera1 : data->camera2;
+			const Mat &distortion = (camera == 0) ? data->distortion1 : data->distortion2;
+			initUndistortRectifyMap(K, distortion, Mat(), K, src.size(), CV_16SC2, data->undistortMap1[camera], data->undistortMap2[camera]);
+			data->undistortMapSize[camera] = src.size();
+		}
+		map1 = data->undistortMap1[camera];
+		map2 = data->undistortMap2[camera];
+	}
+
+	// undistort the image in a single remap pass
+	remap(src, dst, map1, map2, INTER_LINEAR, BORDER_CONSTANT);
+}
+
+void Calibration::undistortPoints(unsigned int camera, const vector<Point2f> &src, vector<Point2f> &dst) const {
+	PROFILE_SCOPE("undistort points");
+
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+
+	// nothing to do for empty input
+	if (src.empty()) {
+		dst.clear();
+		return;
+	}
+
+	// undistort the positions and map them back to pixel positions with the intrinsics
+	const Mat &K = (camera == 0) ? data->camera1 : data->camera2;
+	const Mat &distortion = (camera == 0) ? data->distortion1 : data->distortion2;
+	vector<Point2f> undistorted;
+	cv::undistortPoints(src, undistorted, K, distortion, noArray(), K);
+	dst.swap(undistorted);
+}
+
+void Calibration::undistortPoints(unsigned int camera, TrackBuffer &markers) const {
+	PROFILE_SCOPE("undistort points");
+
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+
+	// nothing to do for empty input
+	if (markers.empty() || markers.getNumberOfMarkers() == 0) {
+		return;
+	}
+
+	// undistort all frames in a single call on a header of the contiguous positions
+	const Mat &K = (camera == 0) ? data->camera1 : data->camera2;
+	const Mat &distortion = (camera == 0) ? data->distortion1 : data->distortion2;
+	Mat positions = markers.getMat().reshape(2, 1);
+	Mat undistorted;
+	cv::undistortPoints(positions, undistorted, K, distortion, noArray(), K);
+	undistorted.copyTo(positions);
+}
+
+void Calibration::distortPoints(unsigned int camera, const vector<Point2f> &src, vector<Point2f> &dst) const {
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+
+	// nothing to do for empty input
+	if (src.empty()) {
+		dst.clear();
+		return;
+	}
+
+	// convert pixel positions to rays in the camera coordinate system
+	const Mat &K = (camera == 0) ? data->camera1 : data->camera2;
+	const Mat &distortion = (camera == 0) ? data->distortion1 : data->distortion2;
+	const Matx33d &KInv = data->inverseCamera[camera];
+	vector<Point3f> rays(src.size());
+	for (unsigned int i = 0; i < src.size(); ++i) {
+		const Vec3d ray = KInv * Vec3d(src[i].x, src[i].y, 1);
+		rays[i] = Point3f(static_cast<float>(ray[0] / ray[2]), static_cast<float>(ray[1] / ray[2]), 1);
+	}
+
+	// and project them with the distortion model of the camera
+	vector<Point2f> distorted;
+	projectPoints(rays, Vec3f(0, 0, 0), Vec3f(0, 0, 0), K, distortion, distorted);
+	dst.swap(distorted);
+}
@@ -1,105 +1,276 @@
-#pragma once
-
-#include <string>
-#include <opencv2/opencv.hpp>
-
-namespace CVLab {
-	/**
-	 * Class for loading and encapsulating calibration data.
-	 * As the calibration data is constant, it is not possible to assign one instance to another.
-	 */
-	class Calibration {
-	public:
-		/**
-		 * Constructor. Creates an object and loads the data from the given folder.
-		 *
-		 * \param[in] folder The folder for loading the calibration data.
-		 */
-		Calibration(const std::string &folder);
-
-		/**
-		 * Copy Constructor. Creates an object by copying the data from another object.
-		 *
-		 * \param[in] other The object to copy the data from.
-		 */
-		Calibration(const Calibration &other);
-
-		/**
-		 * Get the intrinsics of the first camera.
-		 */
-		cv::Mat getCamera1() const;
-
-		/**
-		 * Get the intrinsics of the second camera.
-		 */
-		cv::Mat getCamera2() const;
-
-		/**
-		 * Get the distortion coefficients of the first camera.
-		 */
-		cv::Mat getDistortion1() const;
-
-		/**
-		 * Get the distortion coefficients of the second camera.
-		 */
-		cv::Mat getDistortion2() const;
-
-		/**
-		 * Get the fundamental matrix.
-		 */
-		cv::Mat getFundamentalMat() const;
-
-		/**
-		 * Get the transformation from the first camera to the world coordinate system.
-		 */
-		cv::Mat getTransCamera1World() const;
-
-		/**
-		 * Get the transformation from the first to the second camera.
-		 */
-		cv::Mat getTransCamera1Camera2() const;
-
-	private:
-		/**
-		 * Assignment operator. It is disabled as it is not possible to assign constant values.
-		 *
-		 * \param[in] other The other object that should be assigned to this one.
-		 */
-		Calibration & operator=(const Calibration &other);
-
-		/**
-		 * Intrinsics of the first camera.
-		 */
-		const cv::Mat camera1;
-
-		/**
-		 * Intrinsics of the second camera.
-		 */
-		const cv::Mat camera2;
-
-		/**
-		 * Distortion coefficients of the first camera.
-		 */
-		const cv::Mat distortion1;
-
-		/**
-		 * Distortion coefficients of the second camera.
-		 */
-		const cv::Mat distortion2;
-
-		/**
-		 * Fundamental matrix.
-		 */
-		const cv::Mat fundamentalMat;
-
-		/**
-		 * Transformation from the first camera to the world coordinate system.
-		 */
-		const cv::Mat transCamera1World;
-
-		/**
-		 * Transformation from the first camera to the second camera.
-		 */
-		const cv::Mat transCamera1Camera2;
-	};
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include "MarkerBuffer.hpp"
+
+namespace CVLab {
+	/**
+	 * Class for loading and encapsulating calibration data.
+	 * As the calibration data is constant, it is not possible to assign one instance to another. The data and all
+	 * quantities derived from it are computed once on loading and shared between copies, so copying is cheap and
+	 * the getters hand out references without copying. The returned matrices must not be modified.
+	 */
+	class Calibration {
+	public:
+		/**
+		 * Constructor. Creates an object and loads the data from the given folder. If the folder contains a valid
+		 * calibration bundle that is not older than the CSV files, the data is loaded from the bundle, otherwise
+		 * from the CSV files.
+		 *
+		 * \param[in] folder The folder for loading the calibration data.
+		 */
+		Calibration(const std::string &folder);
+
+		/**
+		 * Copy Constructor. Creates an object sharing the data of another object.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		Calibration(const Calibration &other);
+
+		/**
+		 * Write all calibration data into a binary bundle, which can be loaded faster than the CSV files. The sizes and
+		 * modification times of the CSV files in the folder of the bundle are stored, so that the bundle is ignored once
+		 * one of them has changed.
+		 *
+		 * \param[in] file The file to write the bundle to.
+		 */
+		void writeBundle(const std::string &file) const;
+
+		/**
+		 * Check whether the data has been loaded from a binary bundle.
+		 */
+		bool isLoadedFromBundle() const;
+
+		/**
+		 * Get the intrinsics of the first camera.
+		 */
+		const cv::Mat & getCamera1() const;
+
+		/**
+		 * Get the intrinsics of the second camera.
+		 */
+		const cv::Mat & getCamera2() const;
+
+		/**
+		 * Get the distortion coefficients of the first camera.
+		 */
+		const cv::Mat & getDistortion1() const;
+
+		/**
+		 * Get the distortion coefficients of the second camera.
+		 */
+		const cv::Mat & getDistortion2() const;
+
+		/**
+		 * Get the fundamental matrix.
+		 */
+		const cv::Mat & getFundamentalMat() const;
+
+		/**
+		 * Get the transformation from the first camera to the world coordinate system.
+		 */
+		const cv::Mat & getTransCamera1World() const;
+
+		/**
+		 * Get the transformation from the first to the second camera.
+		 */
+		const cv::Mat & getTransCamera1Camera2() const;
+
+		/**
+		 * Get the fundamental matrix as fixed-size matrix.
+		 */
+		const cv::Matx33d & getFundamentalMatx() const;
+
+		/**
+		 * Get the projection matrix of a camera, which maps points in the coordinate system of the first camera to pixel positions.
+		 *
+		 * \param[in] camera Index of the camera.
+		 */
+		const cv::Matx34d & getProjectionMat(unsigned int camera) const;
+
+		/**
+		 * Get the inverse intrinsics of a camera.
+		 *
+		 * \param[in] camera Index of the camera.
+		 */
+		const cv::Matx33d & getInverseCamera(unsigned int camera) const;
+
+		/**
+		 * Get the transformation from the first camera to the world coordinate system in homogeneous coordinates.
+		 */
+		const cv::Matx44d & getTransCamera1WorldHomogeneous() const;
+
+		/**
+		 * Get a hash value of all calibration data. It can be used to detect whether data derived from the calibration is outdated.
+		 */
+		uint64_t getHash() const;
+
+		/**
+		 * Undistort an image of a camera. The remap tables for the undistortion are computed once for the size of the image
+		 * and reused for all following images of the camera, so undistortion is a single remap pass.
+		 *
+		 * \param[in] camera Index of the camera that recorded the image.
+		 * \param[in] src The distorted image.
+		 * \param[out] dst The undistorted image.
+		 */
+		void undistortImage(unsigned int camera, const cv::Mat &src, cv::Mat &dst) const;
+
+		/**
+		 * Undistort pixel positions of a camera. The result are the pixel positions in the undistorted image.
+		 *
+		 * \param[in] camera Index of the camera the positions belong to.
+		 * \param[in] src Pixel positions in the distorted image.
+		 * \param[out] dst Pixel positions in the undistorted image. It may be the same vector as src.
+		 */
+		void undistortPoints(unsigned int camera, const std::vector<cv::Point2f> &src, std::vector<cv::Point2f> &dst) const;
+
+		/**
+		 * Undistort the pixel positions of a camera in all frames of a buffer at once.
+		 *
+		 * \param[in] camera Index of the camera the positions belong to.
+		 * \param[in,out] markers Pixel positions in the distorted images, which are replaced by the positions in the undistorted images.
+		 */
+		void undistortPoints(unsigned int camera, TrackBuffer &markers) const;
+
+		/**
+		 * Distort pixel positions of a camera. This is the inverse of undistortPoints.
+		 *
+		 * \param[in] camera Index of the camera the positions belong to.
+		 * \param[in] src Pixel positions in the undistorted image.
+		 * \param[out] dst Pixel positions in the distorted image. It may be the same vector as src.
+		 */
+		void distortPoints(unsigned int camera, const std::vector<cv::Point2f> &src, std::vector<cv::Point2f> &dst) const;
+
+	private:
+		/**
+		 * Assignment operator. It is disabled as it is not possible to assign constant values.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		Calibration & operator=(const Calibration &other);
+
+		/**
+		 * Calibration data and derived quantities which are shared between copies.
+		 */
+		struct Data {
+			/**
+			 * Constructor. Loads the data from the given folder and computes the derived quantities.
+			 *
+			 * \param[in] folder The folder for loading the calibration data.
+			 */
+			Data(const std::string &folder);
+
+			/**
+			 * Load the matrices from a binary bundle. The bundle is rejected if it is missing, invalid or one of the CSV files has changed since it was written.
+			 *
+			 * \param[in] folder The folder containing the bundle and the CSV files.
+			 * \returns True if the matrices have been loaded.
+			 */
+			bool readBundle(const std::string &folder);
+
+			/**
+			 * Load the matrices from the CSV files.
+			 *
+			 * \param[in] folder The folder containing the CSV files.
+			 */
+			void readFiles(const std::string &folder);
+
+			/**
+			 * Intrinsics of the first camera.
+			 */
+			cv::Mat camera1;
+
+			/**
+			 * Intrinsics of the second camera.
+			 */
+			cv::Mat camera2;
+
+			/**
+			 * Distortion coefficients of the first camera.
+			 */
+			cv::Mat distortion1;
+
+			/**
+			 * Distortion coefficients of the second camera.
+			 */
+			cv::Mat distortion2;
+
+			/**
+			 * Fundamental matrix.
+			 */
+			cv::Mat fundamentalMat;
+
+			/**
+			 * Transformation from the first camera to the world coordinate system.
+			 */
+			cv::Mat transCamera1World;
+
+			/**
+			 * Transformation from the first camera to the second camera.
+			 */
+			cv::Mat transCamera1Camera2;
+
+			/**
+			 * Fundamental matrix as fixed-size matrix.
+			 */
+			cv::Matx33d fundamentalMatx;
+
+			/**
+			 * Projection matrices of both cameras.
+			 */
+			cv::Matx34d projectionMat[2];
+
+			/**
+			 * Inverse intrinsics of both cameras.
+			 */
+			cv::Matx33d inverseCamera[2];
+
+			/**
+			 * Transformation from the first camera to the world coordinate system in homogeneous coordinates.
+			 */
+			cv::Matx44d transCamera1WorldHomogeneous;
+
+			/**
+			 * Hash value of all calibration data.
+			 */
+			uint64_t hash;
+
+			/**
+			 * Flag indicating whether the data has been loaded from a binary bundle.
+			 */
+			bool loadedFromBundle;
+
+			/**
+			 * Remap tables for the undistortion of both cameras in fixed-point format. They depend on the image size,
+			 * so they are created on first use and then shared by all copies.
+			 */
+			mutable cv::Mat undistortMap1[2];
+
+			/**
+			 * Interpolation tables belonging to undistortMap1.
+			 */
+			mutable cv::Mat undistortMap2[2];
+
+			/**
+			 * Image size the remap tables have been computed for.
+			 */
+			mutable cv::Size undistortMapSize[2];
+
+			/**
+			 * Mutex for creating the remap tables.
+			 */
+			mutable std::mutex undistortMapMutex;
+		};
+
+		/**
+		 * The shared calibration data.
+		 */
+		std::shared_ptr<const Data> data;
+	};
 }
\ No newline at end of file
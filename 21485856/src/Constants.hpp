@@ -1,110 +1,209 @@
-#pragma once
-
-#include <string>
-#include <opencv2/opencv.hpp>
-
-namespace CVLab {
-	namespace Constants {
-		/**
-		 * The character that is used in the files to separate matrix columns.
-		 */
-		const char SeparatorChar = ',';
-
-		/**
-		 * File name of the intrinsics of the first camera.
-		 */
-		const std::string camera1File("K1.csv");
-
-		/**
-		 * File name of the intrinsics of the second camera.
-		 */
-		const std::string camera2File("K2.csv");
-
-		/**
-		 * File name of the distortion coefficients of the first camera.
-		 */
-		const std::string distortion1File("D1.csv");
-
-		/**
-		 * File name of the distortion coefficients of the second camera.
-		 */
-		const std::string distortion2File("D2.csv");
-
-		/**
-		 * File name of the fundamental matrix.
-		 */
-		const std::string fundamentalMatFile("F.csv");
-
-		/**
-		 * File name of the transformation from the first camera to the world coordinate system.
-		 */
-		const std::string extCamera1WorldFile("T_C1_W.csv");
-
-		/**
-		 * File name of the transformation from the first camera to the second camera.
-		 */
-		const std::string extCamera1Camera2File("T_C1_C2.csv");
-
-		/**
-		 * File name of the video file from the first camera.
-		 */
-		const std::string sequence1File("MarkerSequence_1.avi");
-
-		/**
-		 * File name of the video file from the second camera.
-		 */
-		const std::string sequence2File("MarkerSequence_2.avi");
-
-		/**
-		 * File name of the initial marker positions for the first camera.
-		 */
-		const std::string markers1File("markers1.csv");
-
-		/**
-		 * File name of the initial marker positions for the second camera.
-		 */
-		const std::string markers2File("markers2.csv");
-
-		/**
-		 * Size of the search window in refinement of the marker positions.
-		 */
-		const cv::Size markerRefinementWindowSize(5, 5);
-
-		/**
-		 * Size of the zero zone in refinement of the marker positions.
-		 */
-		const cv::Size markerRefinementZeroZone(-1, -1);
-
-		/**
-		 * Termination criteria for refinement of markers positions.
-		 */
-		const cv::TermCriteria markerRefinementCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 40, 0.001);
-
-		/**
-		 * Size of the cross when drawing markers on an image.
-		 */
-		const unsigned int markerSize = 5;
-
-		/**
-		 * Frame rate in fps when showing a sequence with markers on it.
-		 */
-		const unsigned short frameRate = 4;
-
-		/**
-		 * Get the color for the marker with the given index.
-		 *
-		 * \param[in] index Index of the marker.
-		 */
-		template<typename T> cv::Scalar getMarkerColor(T index) {
-			T m = index % 3;
-			switch (m) {
-			case 0:
-				return cv::Scalar(0, 0, 255);
-			case 1:
-				return cv::Scalar(0, 255, 0);
-			default:
-				return cv::Scalar(255, 0, 0);
-			}
-		}
-	}
+#pragma once
+
+#include <string>
+#include <opencv2/opencv.hpp>
+
+namespace CVLab {
+	namespace Constants {
+		/**
+		 * The character that is used in the files to separate matrix columns.
+		 */
+		const char SeparatorChar = ',';
+
+		/**
+		 * File name of the intrinsics of the first camera.
+		 */
+		const std::string camera1File("K1.csv");
+
+		/**
+		 * File name of the intrinsics of the second camera.
+		 */
+		const std::string camera2File("K2.csv");
+
+		/**
+		 * File name of the distortion coefficients of the first camera.
+		 */
+		const std::string distortion1File("D1.csv");
+
+		/**
+		 * File name of the distortion coefficients of the second camera.
+		 */
+		const std::string distortion2File("D2.csv");
+
+		/**
+		 * File name of the fundamental matrix.
+		 */
+		const std::string fundamentalMatFile("F.csv");
+
+		/**
+		 * File name of the transformation from the first camera to the world coordinate system.
+		 */
+		const std::string extCamera1WorldFile("T_C1_W.csv");
+
+		/**
+		 * File name of the transformation from the first camera to the second camera.
+		 */
+		const std::string extCamera1Camera2File("T_C1_C2.csv");
+
+		/**
+		 * File name of the binary bundle containing all calibration data.
+		 */
+		const std::string calibrationBundleFile("calibration.bin");
+
+		/**
+		 * File name of the video file from the first camera.
+		 */
+		const std::string sequence1File("MarkerSequence_1.avi");
+
+		/**
+		 * File name of the video file from the second camera.
+		 */
+		const std::string sequence2File("MarkerSequence_2.avi");
+
+		/**
+		 * File name of the initial marker positions for the first camera.
+		 */
+		const std::string markers1File("markers1.csv");
+
+		/**
+		 * File name of the initial marker positions for the second camera.
+		 */
+		const std::string markers2File("markers2.csv");
+
+		/**
+		 * File name of the ground truth positions of the markers of a generated sequence.
+		 */
+		const std::string groundTruthFile("ground_truth.csv");
+
+		/**
+		 * Size of the search window in refinement of the marker positions.
+		 */
+		const cv::Size markerRefinementWindowSize(5, 5);
+
+		/**
+		 * Size of the zero zone in refinement of the marker positions.
+		 */
+		const cv::Size markerRefinementZeroZone(-1, -1);
+
+		/**
+		 * Termination criteria for refinement of markers positions.
+		 */
+		const cv::TermCriteria markerRefinementCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 40, 0.001);
+
+		/**
+		 * Size of the search window at each pyramid level when tracking the markers.
+		 */
+		const cv::Size trackingWindowSize(11, 11);
+
+		/**
+		 * Maximal 0-based pyramid level used when tracking the markers.
+		 */
+		const int trackingPyramidLevels = 5;
+
+		/**
+		 * Padding around the marker positions for the regions the tracking is restricted to in region tracking mode.
+		 * A marker can only be tracked over half the search window on the highest pyramid level, which corresponds to
+		 * a displacement of (windowSize / 2) * 2^levels in the original image. The padding covers this plus the search window itself.
+		 */
+		const int trackingRegionPadding = ((trackingWindowSize.width / 2) << trackingPyramidLevels) + trackingWindowSize.width;
+
+		/**
+		 * Number of frames each chunk starts before its first frame in chunked tracking. These frames are also tracked by
+		 * the previous chunk, so the chunk can be checked against it.
+		 */
+		const unsigned int trackingChunkOverlap = 10;
+
+		/**
+		 * Maximal distance in pixels between the positions of a chunk and the previous chunk in the overlapping frames in chunked
+		 * tracking. A chunk exceeding it for any marker is tracked again serially from the end of the previous chunk.
+		 */
+		const float trackingChunkTolerance = 0.5f;
+
+		/**
+		 * Number of times the images are downscaled by a factor of 2 for the coarse tracking pass predicting the start positions of the chunks.
+		 */
+		const int trackingCoarseLevels = 2;
+
+		/**
+		 * Number of repetitions when measuring the runtime of the correction methods before triangulation.
+		 */
+		const unsigned int correctionBenchmarkRepetitions = 100;
+
+		/**
+		 * Size of the cross when drawing markers on an image.
+		 */
+		const unsigned int markerSize = 5;
+
+		/**
+		 * Frame rate in fps when showing a sequence with markers on it.
+		 */
+		const unsigned short frameRate = 4;
+
+		/**
+		 * Maximum number of images that are rendered into files in the background at the same time.
+		 */
+		const size_t maxPendingImages = 8;
+
+		/**
+		 * Number of frames each queue between two stages of the pipeline can hold.
+		 */
+		const size_t pipelineQueueCapacity = 8;
+
+		/**
+		 * Frame rate in fps of the videos of a generated sequence.
+		 */
+		const double generatorFrameRate = 25;
+
+		/**
+		 * Minimal distance in pixels of the markers of a generated sequence to the image borders in the first frame.
+		 */
+		const float generatorImageBorder = 40;
+
+		/**
+		 * Maximal number of random positions that are tried for each marker of a generated sequence.
+		 */
+		const unsigned int generatorPlacementAttempts = 1000;
+
+		/**
+		 * Default number of decimal places of the coordinates in the result file. It matches the output of std::to_string.
+		 */
+		const int resultPrecision = 6;
+
+		/**
+		 * Size of the buffer for formatting the result file in bytes.
+		 */
+		const size_t resultBufferSize = 1 << 20;
+
+		/**
+		 * Number of frames that can be queued for the background thread writing the result file.
+		 */
+		const size_t resultQueueCapacity = 256;
+
+		/**
+		 * Number of times a thread waiting for the result queue yields before it starts sleeping.
+		 */
+		const unsigned int resultWriterSpins = 64;
+
+		/**
+		 * Time in microseconds a thread waiting for the result queue sleeps between checks.
+		 */
+		const unsigned int resultWriterSleep = 100;
+
+		/**
+		 * Get the color for the marker with the given index.
+		 *
+		 * \param[in] index Index of the marker.
+		 */
+		template<typename T> cv::Scalar getMarkerColor(T index) {
+			T m = index % 3;
+			switch (m) {
+			case 0:
+				return cv::Scalar(0, 0, 255);
+			case 1:
+				return cv::Scalar(0, 255, 0);
+			default:
+				return cv::Scalar(255, 0, 0);
+			}
+		}
+	}
 }
\ No newline at end of file
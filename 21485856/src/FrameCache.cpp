@@ -0,0 +1,242 @@
+#include "FrameCache.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+#include "tools.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+namespace {
+	/**
+	 * Header at the beginning of a cache file. It is followed by the table of frame offsets.
+	 */
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t undistorted;
+		uint32_t numberOfFrames;
+		uint32_t rows;
+		uint32_t cols;
+		uint32_t reserved;
+		uint64_t calibrationHash;
+		uint64_t videoHash[2];
+	};
+
+	/**
+	 * Identification of a cache file.
+	 */
+	const char cacheMagic[8] = { '3', 'D', 'C', 'V', 'F', 'R', 'M', '\0' };
+
+	/**
+	 * Version of the cache file format.
+	 */
+	const uint32_t cacheVersion = 1;
+
+	/**
+	 * Alignment of the images in the cache file in bytes.
+	 */
+	const uint64_t cacheAlignment = 64;
+
+	/**
+	 * Round a file offset up to the alignment of the images.
+	 *
+	 * \param[in] offset The offset to align.
+	 */
+	uint64_t alignOffset(uint64_t offset) {
+		return (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+	}
+
+	/**
+	 * Get the offset of the image of a frame in the cache file.
+	 *
+	 * \param[in] numberOfFrames Number of frames in the cache.
+	 * \param[in] size Size of the images.
+	 * \param[in] frame Index of the frame.
+	 * \param[in] camera Index of the camera.
+	 */
+	uint64_t imageOffset(unsigned int numberOfFrames, const Size &size, unsigned int frame, unsigned int camera) {
+		const uint64_t dataOffset = alignOffset(sizeof(Header) + 2 * static_cast<uint64_t>(numberOfFrames) * sizeof(uint64_t));
+		const uint64_t imageSize = alignOffset(static_cast<uint64_t>(size.width) * size.height);
+		return dataOffset + (2 * static_cast<uint64_t>(frame) + camera) * imageSize;
+	}
+}
+
+FrameCache::Key FrameCache::createKey(const Calibration &calib, const string &videoFile1, const string &videoFile2, bool undistorted) {
+	Key key;
+	key.calibrationHash = calib.getHash();
+	key.videoHash[0] = hashVideo(videoFile1);
+	key.videoHash[1] = hashVideo(videoFile2);
+	key.undistorted = undistorted;
+	return key;
+}
+
+shared_ptr<FrameCache> FrameCache::open(const string &file, const Key &key) {
+	// check if the file exists
+	if (!ifstream(file).is_open()) {
+		return nullptr;
+	}
+
+	// map the file and check the header
+	unique_ptr<MappedFile> mapped(new MappedFile(file));
+	if (mapped->getSize() < sizeof(Header)) {
+		return nullptr;
+	}
+	Header header;
+	memcpy(&header, mapped->getData(), sizeof(Header));
+	if ((memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0) || (header.version != cacheVersion)) {
+		return nullptr;
+	}
+
+	// check if the cache has been created from the same data
+	if ((header.calibrationHash != key.calibrationHash) || (header.videoHash[0] != key.videoHash[0]) || (header.videoHash[1] != key.videoHash[1]) || ((header.undistorted != 0) != key.undistorted)) {
+		return nullptr;
+	}
+
+	// check if the file contains the offset table
+	if ((header.numberOfFrames == 0) || (mapped->getSize() < sizeof(Header) + 2 * static_cast<uint64_t>(header.numberOfFrames) * sizeof(uint64_t))) {
+		return nullptr;
+	}
+
+	// check if all images are inside of the file
+	const Size size(header.cols, header.rows);
+	const uint64_t *offsets = reinterpret_cast<const uint64_t *>(mapped->getData() + sizeof(Header));
+	for (unsigned int i = 0; i < 2 * header.numberOfFrames; ++i) {
+		if (offsets[i] + static_cast<uint64_t>(size.width) * size.height > mapped->getSize()) {
+			return nullptr;
+		}
+	}
+
+	// create cache for the mapped file
+	shared_ptr<FrameCache> cache(new FrameCache(move(mapped)));
+	cache->numberOfFrames = header.numberOfFrames;
+	cache->size = size;
+	cache->offsets = offsets;
+	return cache;
+}
+
+FrameCache::FrameCache(unique_ptr<MappedFile> file) : file(move(file)), numberOfFrames(0), offsets(nullptr) {
+}
+
+unsigned int FrameCache::getNumberOfFrames() const {
+	return numberOfFrames;
+}
+
+Mat FrameCache::getFrame(unsigned int camera, unsigned int frame) const {
+	// check camera and frame index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+	if (frame >= numberOfFrames) {
+		throw "frame " + to_string(frame) + " is not in the cache";
+	}
+
+	// create matrix header referencing the mapped file
+	return Mat(size, CV_8UC1, file->getData() + offsets[2 * frame + camera]);
+}
+
+uint64_t FrameCache::hashVideo(const string &file) {
+	// get the size and the modification time of the video file, so a rewritten video changes the hash value
+	uint64_t fileSize;
+	int64_t modificationTime;
+	ifstream input(file, ios_base::in | ios_base::binary);
+	if (!input.is_open() || !getFileStatus(file, fileSize, modificationTime)) {
+		throw "could not open video file " + file;
+	}
+	uint64_t hash = hashData(&fileSize, sizeof(fileSize));
+	hash = hashData(&modificationTime, sizeof(modificationTime), hash);
+
+	// combine the data at the beginning and the end of the file
+	const uint64_t blockSize = 64 * 1024;
+	vector<char> block(static_cast<size_t>(min(blockSize, fileSize)));
+	for (uint64_t position : { static_cast<uint64_t>(0), fileSize - block.size() }) {
+		input.seekg(position);
+		input.read(block.data(), block.size());
+		hash = hashData(block.data(), static_cast<size_t>(input.gcount()), hash);
+	}
+	return hash;
+}
+
+FrameCache::Writer::Writer(const string &file, const Key &key, unsigned int numberOfFrames, const Size &size) : file(file), tempFile(file + ".tmp"), numberOfFrames(numberOfFrames), size(size), writtenFrames(0) {
+	// open temporary file
+	output.open(tempFile, ios_base::out | ios_base::trunc | ios_base::binary);
+	if (!output.is_open()) {
+		throw "could not open file " + tempFile + " for writing frame cache.";
+	}
+
+	// write header
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = cacheVersion;
+	header.undistorted = key.undistorted ? 1 : 0;
+	header.numberOfFrames = numberOfFrames;
+	header.rows = size.height;
+	header.cols = size.width;
+	header.calibrationHash = key.calibrationHash;
+	header.videoHash[0] = key.videoHash[0];
+	header.videoHash[1] = key.videoHash[1];
+	output.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+
+	// write table of frame offsets
+	vector<uint64_t> offsets(2 * numberOfFrames);
+	for (unsigned int frame = 0; frame < numberOfFrames; ++frame) {
+		offsets[2 * frame] = imageOffset(numberOfFrames, size, frame, 0);
+		offsets[2 * frame + 1] = imageOffset(numberOfFrames, size, frame, 1);
+	}
+	output.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(uint64_t));
+}
+
+FrameCache::Writer::~Writer() {
+	// remove the incomplete temporary file
+	if (output.is_open()) {
+		output.close();
+		remove(tempFile.c_str());
+	}
+}
+
+void FrameCache::Writer::write(const Mat &image1, const Mat &image2) {
+	// check if there is space for another frame
+	if (writtenFrames >= numberOfFrames) {
+		throw "all frames of the frame cache have already been written";
+	}
+
+	// write images of both cameras
+	writeImage(image1);
+	writeImage(image2);
+	++writtenFrames;
+
+	// replace the cache file by the temporary file after the last frame
+	if (writtenFrames == numberOfFrames) {
+		output.close();
+		if (output.fail()) {
+			remove(tempFile.c_str());
+			throw "could not write frame cache " + tempFile;
+		}
+		remove(file.c_str());
+		if (rename(tempFile.c_str(), file.c_str()) != 0) {
+			remove(tempFile.c_str());
+			throw "could not rename " + tempFile + " to " + file;
+		}
+	}
+}
+
+void FrameCache::Writer::writeImage(const Mat &image) {
+	// check image format
+	if ((image.type() != CV_8UC1) || (image.size() != size)) {
+		throw "images in the frame cache must be 8 bit grayscale images of the same size";
+	}
+
+	// pad the file up to the aligned position of the image
+	const uint64_t position = static_cast<uint64_t>(output.tellp());
+	const vector<char> padding(static_cast<size_t>(alignOffset(position) - position), 0);
+	output.write(padding.data(), padding.size());
+
+	// write the image row by row
+	for (int row = 0; row < image.rows; ++row) {
+		output.write(reinterpret_cast<const char *>(image.ptr(row)), image.cols);
+	}
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+#include "Calibration.hpp"
+#include "MappedFile.hpp"
+
+namespace CVLab {
+	/**
+	 * Class for a persistent cache of the preprocessed frames of a sequence.
+	 * The cache file consists of a header, a table with the offset of each frame and the grayscale images of both cameras.
+	 * The header contains hash values of the calibration data and of both videos, so a cache is only used if neither has changed.
+	 * A cache file is mapped into memory and the frames are returned as matrices referencing the mapped memory without copying.
+	 */
+	class FrameCache {
+	public:
+		/**
+		 * Values identifying the data the cached frames have been created from.
+		 */
+		struct Key {
+			/**
+			 * Hash value of the calibration data.
+			 */
+			uint64_t calibrationHash;
+
+			/**
+			 * Hash values of both video files.
+			 */
+			uint64_t videoHash[2];
+
+			/**
+			 * Flag indicating whether the images are undistorted.
+			 */
+			bool undistorted;
+		};
+
+		/**
+		 * Class for writing a cache file frame by frame.
+		 * The data is written to a temporary file which replaces the cache file when all frames have been written,
+		 * so an incomplete cache file is never used.
+		 */
+		class Writer {
+		public:
+			/**
+			 * Constructor. Creates the temporary file and writes the header.
+			 *
+			 * \param[in] file The cache file to be written.
+			 * \param[in] key Values identifying the data the frames are created from.
+			 * \param[in] numberOfFrames Number of frames in the sequence.
+			 * \param[in] size Size of the images.
+			 */
+			Writer(const std::string &file, const Key &key, unsigned int numberOfFrames, const cv::Size &size);
+
+			/**
+			 * Destructor. Removes the temporary file if not all frames have been written.
+			 */
+			~Writer();
+
+			/**
+			 * Write the images of the next frame.
+			 * When the last frame is written, the temporary file replaces the cache file.
+			 *
+			 * \param[in] image1 The image of the first camera.
+			 * \param[in] image2 The image of the second camera.
+			 */
+			void write(const cv::Mat &image1, const cv::Mat &image2);
+
+		private:
+			/**
+			 * Copy Constructor. It is disabled as the file can only be written once.
+			 *
+			 * \param[in] other The object to copy the data from.
+			 */
+			Writer(const Writer &other);
+
+			/**
+			 * Assignment operator. It is disabled as the file can only be written once.
+			 *
+			 * \param[in] other The other object that should be assigned to this one.
+			 */
+			Writer & operator=(const Writer &other);
+
+			/**
+			 * Write a single image at the current position of the file.
+			 *
+			 * \param[in] image The image to write.
+			 */
+			void writeImage(const cv::Mat &image);
+
+			/**
+			 * The cache file to be written.
+			 */
+			const std::string file;
+
+			/**
+			 * The temporary file the data is written to.
+			 */
+			const std::string tempFile;
+
+			/**
+			 * Stream of the temporary file.
+			 */
+			std::ofstream output;
+
+			/**
+			 * Number of frames in the sequence.
+			 */
+			const unsigned int numberOfFrames;
+
+			/**
+			 * Size of the images.
+			 */
+			const cv::Size size;
+
+			/**
+			 * Number of frames written so far.
+			 */
+			unsigned int writtenFrames;
+		};
+
+		/**
+		 * Create the key for the given calibration data and videos.
+		 *
+		 * \param[in] calib Calibration data.
+		 * \param[in] videoFile1 The video file of the first camera.
+		 * \param[in] videoFile2 The video file of the second camera.
+		 * \param[in] undistorted Flag indicating whether the images are undistorted.
+		 */
+		static Key createKey(const Calibration &calib, const std::string &videoFile1, const std::string &videoFile2, bool undistorted);
+
+		/**
+		 * Open a cache file.
+		 *
+		 * \param[in] file The cache file to open.
+		 * \param[in] key Values identifying the data the frames have to be created from.
+		 * \returns The opened cache or a null pointer if the file does not exist, is invalid or does not match the key.
+		 */
+		static std::shared_ptr<FrameCache> open(const std::string &file, const Key &key);
+
+		/**
+		 * Get the number of frames in the cache.
+		 */
+		unsigned int getNumberOfFrames() const;
+
+		/**
+		 * Get the image of a frame. The returned matrix references the mapped file, so it is only valid as long as the cache exists.
+		 *
+		 * \param[in] camera Index of the camera to get the image for.
+		 * \param[in] frame Index of the frame.
+		 */
+		cv::Mat getFrame(unsigned int camera, unsigned int frame) const;
+
+	private:
+		/**
+		 * Constructor. Use open to create an instance.
+		 *
+		 * \param[in] file The mapped cache file.
+		 */
+		FrameCache(std::unique_ptr<MappedFile> file);
+
+		/**
+		 * Calculate a hash value of a video file from its size, its modification time and the data at its beginning and its end.
+		 *
+		 * \param[in] file The video file.
+		 */
+		static uint64_t hashVideo(const std::string &file);
+
+		/**
+		 * The mapped cache file.
+		 */
+		std::unique_ptr<MappedFile> file;
+
+		/**
+		 * Number of frames in the cache.
+		 */
+		unsigned int numberOfFrames;
+
+		/**
+		 * Size of the images.
+		 */
+		cv::Size size;
+
+		/**
+		 * Offsets of the images in the file. The image of frame i for camera c is at position 2 * i + c.
+		 */
+		const uint64_t *offsets;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,275 @@
+#include "Generator.hpp"
+
+#include <cmath>
+#include <future>
+#include <algorithm>
+
+#include "Constants.hpp"
+#include "Sequence.hpp"
+#include "Profiler.hpp"
+#include "tools.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+Generator::Generator(const Calibration &c, const Settings &settings) : calib(c), settings(settings), transWorldCamera1(c.getTransCamera1WorldHomogeneous().inv()) {
+	// check the settings
+	if ((settings.numberOfMarkers == 0) || (settings.numberOfFrames == 0)) {
+		throw "a generated sequence needs at least one marker and one frame";
+	}
+	if ((settings.frameSize.width <= 2 * Constants::generatorImageBorder) || (settings.frameSize.height <= 2 * Constants::generatorImageBorder)) {
+		throw "the frame size of a generated sequence is too small";
+	}
+	if ((settings.distance <= 0) || (settings.period <= 0) || (settings.markerRadius <= 0) || (settings.noise < 0)) {
+		throw "invalid settings for generating a sequence";
+	}
+}
+
+PointCloudSequence Generator::createTrajectories() const {
+	RNG rng(settings.seed);
+	const float border = Constants::generatorImageBorder;
+	const float minDistance = 3 * settings.markerRadius;
+	const Matx33d &KInv = calib.getInverseCamera(0);
+	const Matx34d &proj2 = calib.getProjectionMat(1);
+
+	// place the markers randomly inside the images of both cameras and apart from each other
+	vector<Point3f> base;
+	vector<Point2f> placed[2];
+	base.reserve(settings.numberOfMarkers);
+	for (unsigned int marker = 0; marker < settings.numberOfMarkers; ++marker) {
+		bool found = false;
+		for (unsigned int attempt = 0; !found && (attempt < Constants::generatorPlacementAttempts); ++attempt) {
+			// cast a ray through a random pixel of the first camera
+			const Point2f pos1(rng.uniform(border, settings.frameSize.width - border), rng.uniform(border, settings.frameSize.height - border));
+			const double depth = settings.distance * rng.uniform(0.9, 1.1);
+			const Vec3d ray = KInv * Vec3d(pos1.x, pos1.y, 1);
+			const Vec3d point = ray * (depth / ray[2]);
+
+			// and check if the position is visible in the second camera
+			const Vec3d projected = proj2 * Vec4d(point[0], point[1], point[2], 1);
+			const Point2f pos2(static_cast<float>(projected[0] / projected[2]), static_cast<float>(projected[1] / projected[2]));
+			if ((projected[2] <= 0) || (pos2.x < border) || (pos2.y < border) || (pos2.x > settings.frameSize.width - border) || (pos2.y > settings.frameSize.height - border)) {
+				continue;
+			}
+
+			// the markers must not overlap in any image, otherwise they cannot be told apart
+			found = true;
+			for (unsigned int other = 0; found && (other < base.size()); ++other) {
+				found = (norm(placed[0][other] - pos1) >= minDistance) && (norm(placed[1][other] - pos2) >= minDistance);
+			}
+			if (found) {
+				base.push_back(Point3f(static_cast<float>(point[0]), static_cast<float>(point[1]), static_cast<float>(point[2])));
+				placed[0].push_back(pos1);
+				placed[1].push_back(pos2);
+			}
+		}
+		if (!found) {
+			throw "could not place " + to_string(settings.numberOfMarkers) + " markers, use fewer or smaller markers or larger frames";
+		}
+	}
+
+	// the wave travels once across the markers
+	float minX = base[0].x, maxX = base[0].x;
+	for (const auto &point : base) {
+		minX = min(minX, point.x);
+		maxX = max(maxX, point.x);
+	}
+	const float waveLength = max(maxX - minX, 1.0f);
+
+	// move the markers in the coordinate system of the first camera and transform them into the world coordinate system
+	const Matx44d &trans = calib.getTransCamera1WorldHomogeneous();
+	PointCloudSequence trajectories(settings.numberOfFrames, settings.numberOfMarkers);
+	for (unsigned int frame = 0; frame < settings.numberOfFrames; ++frame) {
+		const float phase = static_cast<float>(2 * CV_PI * frame / settings.period);
+		Point3f *positions = trajectories[frame];
+		for (unsigned int marker = 0; marker < settings.numberOfMarkers; ++marker) {
+			Point3f point = base[marker];
+			switch (settings.trajectory) {
+			case Trajectory::Circle:
+				point += settings.amplitude * Point3f(cos(phase) - 1, sin(phase), 0);
+				break;
+			case Trajectory::Wave:
+				point.z += settings.amplitude * sin(phase - static_cast<float>(2 * CV_PI) * (point.x - minX) / waveLength);
+				break;
+			default:
+				break;
+			}
+			const Vec4d world = trans * Vec4d(point.x, point.y, point.z, 1);
+			positions[marker] = Point3f(static_cast<float>(world[0]), static_cast<float>(world[1]), static_cast<float>(world[2]));
+		}
+	}
+	return trajectories;
+}
+
+PointCloudSequence Generator::readTrajectories(const string &file) {
+	// read raw data from file
+	const Mat data = readMatrix(file);
+	checkMatrixDimensions(data, -1, 5, "trajectories");
+	if (data.rows == 0) {
+		throw "no trajectories in file " + file;
+	}
+
+	// get the number of frames and markers from the highest indices
+	double maxFrame, maxMarker;
+	minMaxIdx(data.col(0), nullptr, &maxFrame);
+	minMaxIdx(data.col(1), nullptr, &maxMarker);
+	const unsigned int numberOfFrames = static_cast<unsigned int>(maxFrame) + 1;
+	const unsigned int numberOfMarkers = static_cast<unsigned int>(maxMarker) + 1;
+	if (static_cast<size_t>(data.rows) != static_cast<size_t>(numberOfFrames) * numberOfMarkers) {
+		throw "the trajectories in file " + file + " do not contain every marker in every frame";
+	}
+
+	// save the positions by the indices in each line
+	PointCloudSequence trajectories(numberOfFrames, numberOfMarkers);
+	for (int row = 0; row < data.rows; ++row) {
+		const float *values = data.ptr<float>(row);
+		if ((values[0] < 0) || (values[1] < 0)) {
+			throw "negative index in trajectories in file " + file;
+		}
+		trajectories[static_cast<unsigned int>(values[0])][static_cast<unsigned int>(values[1])] = Point3f(values[2], values[3], values[4]);
+	}
+	return trajectories;
+}
+
+void Generator::operator()(const string &folder, const PointCloudSequence &trajectories, const string &cacheFile) const {
+	if (trajectories.empty() || (trajectories.getNumberOfMarkers() == 0)) {
+		throw "no trajectories to generate a sequence from";
+	}
+	const unsigned int numberOfMarkers = trajectories.getNumberOfMarkers();
+
+	// open the videos of both cameras
+	const string videoFiles[2] = { folder + Constants::sequence1File, folder + Constants::sequence2File };
+	VideoWriter videos[2];
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		if (!videos[camera].open(videoFiles[camera], VideoWriter::fourcc('M', 'J', 'P', 'G'), Constants::generatorFrameRate, settings.frameSize)) {
+			throw "could not open video file " + videoFiles[camera] + " for writing";
+		}
+	}
+
+	// each camera has its own noise, so both can be rendered concurrently
+	RNG rngs[2] = { RNG(settings.seed + 1), RNG(settings.seed + 2) };
+	vector<Point2f> undistorted[2], distorted[2];
+	Mat images[2];
+	const Rect imageRect(Point(0, 0), settings.frameSize);
+	unsigned int outsidePositions = 0;
+	for (unsigned int frame = 0; frame < trajectories.getNumberOfFrames(); ++frame) {
+		projectFrame(trajectories[frame], numberOfMarkers, undistorted, distorted);
+		for (unsigned int camera = 0; camera < 2; ++camera) {
+			for (const auto &pos : distorted[camera]) {
+				if (!imageRect.contains(pos)) {
+					++outsidePositions;
+				}
+			}
+		}
+
+		// the marker files contain the positions in the undistorted images of the first frame
+		if (frame == 0) {
+			const string markerFiles[2] = { folder + Constants::markers1File, folder + Constants::markers2File };
+			for (unsigned int camera = 0; camera < 2; ++camera) {
+				Mat markerData(static_cast<int>(numberOfMarkers), 2, CV_64F);
+				for (int i = 0; i < markerData.rows; ++i) {
+					markerData.at<double>(i, 0) = undistorted[camera][i].x;
+					markerData.at<double>(i, 1) = undistorted[camera][i].y;
+				}
+				writeMatrix(markerFiles[camera], markerData);
+			}
+		}
+
+		// render and encode the image of the second camera on a separate thread
+		auto second = async(launch::async, [&]() {
+			renderImage(distorted[1], rngs[1], images[1]);
+			videos[1].write(images[1]);
+		});
+		renderImage(distorted[0], rngs[0], images[0]);
+		videos[0].write(images[0]);
+		second.get();
+	}
+	for (auto &video : videos) {
+		video.release();
+	}
+	if (outsidePositions > 0) {
+		logMessage(to_string(outsidePositions) + " generated marker positions are outside of the images");
+	}
+
+	// write the ground truth in the format of the result file
+	writeResult(folder + Constants::groundTruthFile, trajectories);
+
+	// decode the written videos once, so the cache contains exactly the images a sequence loads from them
+	if (!cacheFile.empty()) {
+		Sequence sequence(folder, calib, 2, true, cacheFile);
+		while (sequence.readNextFrame()) {
+		}
+	}
+}
+
+void Generator::writeCalibration(const string &folder, const Size &frameSize) {
+	// both cameras have the same intrinsics and a slight radial distortion
+	const Matx33d K(1000, 0, frameSize.width / 2.0, 0, 1000, frameSize.height / 2.0, 0, 0, 1);
+	const Matx<double, 1, 5> D(-0.1, 0.01, 0, 0, 0);
+
+	// the second camera is shifted along the x-axis and slightly rotated around the y-axis towards the first one
+	const double angle = 5 * CV_PI / 180;
+	const Matx33d R(cos(angle), 0, sin(angle), 0, 1, 0, -sin(angle), 0, cos(angle));
+	const Vec3d t(-200, 0, 0);
+	Matx34d transCamera1Camera2;
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 3; ++col) {
+			transCamera1Camera2(row, col) = R(row, col);
+		}
+		transCamera1Camera2(row, 3) = t[row];
+	}
+
+	// the fundamental matrix follows from the intrinsics and the relative pose
+	const Matx33d tx(0, -t[2], t[1], t[2], 0, -t[0], -t[1], t[0], 0);
+	const Matx33d F = K.inv().t() * tx * R * K.inv();
+
+	writeMatrix(folder + Constants::camera1File, Mat(K));
+	writeMatrix(folder + Constants::camera2File, Mat(K));
+	writeMatrix(folder + Constants::distortion1File, Mat(D));
+	writeMatrix(folder + Constants::distortion2File, Mat(D));
+	writeMatrix(folder + Constants::fundamentalMatFile, Mat(F));
+	writeMatrix(folder + Constants::extCamera1WorldFile, Mat(Matx34d::eye()));
+	writeMatrix(folder + Constants::extCamera1Camera2File, Mat(transCamera1Camera2));
+}
+
+void Generator::projectFrame(const Point3f *positions, unsigned int numberOfMarkers, vector<Point2f> undistorted[2], vector<Point2f> distorted[2]) const {
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		// transform the positions into the first camera and project them without distortion
+		const Matx34d &proj = calib.getProjectionMat(camera);
+		undistorted[camera].resize(numberOfMarkers);
+		for (unsigned int i = 0; i < numberOfMarkers; ++i) {
+			const Vec4d point = transWorldCamera1 * Vec4d(positions[i].x, positions[i].y, positions[i].z, 1);
+			const Vec3d projected = proj * point;
+			undistorted[camera][i] = Point2f(static_cast<float>(projected[0] / projected[2]), static_cast<float>(projected[1] / projected[2]));
+		}
+
+		// and apply the distortion of the camera
+		calib.distortPoints(camera, undistorted[camera], distorted[camera]);
+	}
+}
+
+void Generator::renderImage(const vector<Point2f> &positions, RNG &rng, Mat &image) const {
+	PROFILE_SCOPE("render");
+
+	// draw the markers with subpixel accuracy and smooth their edges like a lens
+	const int shift = 4;
+	const double scale = 1 << shift;
+	Mat gray(settings.frameSize, CV_8UC1, Scalar(0));
+	for (const auto &pos : positions) {
+		circle(gray, Point(cvRound(pos.x * scale), cvRound(pos.y * scale)), cvRound(settings.markerRadius * scale), Scalar(255), FILLED, LINE_AA, shift);
+	}
+	GaussianBlur(gray, gray, Size(5, 5), 1.0);
+
+	// add sensor noise
+	if (settings.noise > 0) {
+		Mat noisy, noise(settings.frameSize, CV_16SC1);
+		rng.fill(noise, RNG::NORMAL, 0, settings.noise);
+		gray.convertTo(noisy, CV_16SC1);
+		noisy += noise;
+		noisy.convertTo(gray, CV_8UC1);
+	}
+
+	// the videos are stored in color like the recorded ones
+	cvtColor(gray, image, COLOR_GRAY2BGR);
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "Calibration.hpp"
+#include "MarkerBuffer.hpp"
+
+namespace CVLab {
+	/**
+	 * Generator of synthetic stereo sequences. The markers move on 3D trajectories, which are projected into both
+	 * cameras with the intrinsics and distortion of the calibration and rendered as bright blobs. The sequence is
+	 * written like a recorded one, i.e. as videos of both cameras and the initial marker positions, together with
+	 * the ground truth positions of the markers, so the results of processing it can be checked for accuracy.
+	 */
+	class Generator {
+	public:
+		/**
+		 * Kinds of generated trajectories.
+		 */
+		enum class Trajectory {
+			/**
+			 * The markers do not move.
+			 */
+			Static,
+
+			/**
+			 * All markers move on the same circle parallel to the image plane of the first camera.
+			 */
+			Circle,
+
+			/**
+			 * The markers move along the viewing direction of the first camera with a wave travelling across them.
+			 */
+			Wave
+		};
+
+		/**
+		 * Settings of a generated sequence. Lengths are given in the unit of the calibration data.
+		 */
+		struct Settings {
+			/**
+			 * Number of markers.
+			 */
+			unsigned int numberOfMarkers = 100;
+
+			/**
+			 * Number of frames.
+			 */
+			unsigned int numberOfFrames = 100;
+
+			/**
+			 * Size of the images.
+			 */
+			cv::Size frameSize = cv::Size(640, 480);
+
+			/**
+			 * Kind of the trajectories.
+			 */
+			Trajectory trajectory = Trajectory::Circle;
+
+			/**
+			 * Mean distance of the markers from the first camera. The distances vary by 10 percent.
+			 */
+			float distance = 2000;
+
+			/**
+			 * Amplitude of the motion of the markers.
+			 */
+			float amplitude = 10;
+
+			/**
+			 * Number of frames of a period of the motion of the markers.
+			 */
+			float period = 50;
+
+			/**
+			 * Radius of the markers in pixels.
+			 */
+			float markerRadius = 3;
+
+			/**
+			 * Standard deviation of the Gaussian noise added to the images in gray values.
+			 */
+			float noise = 2;
+
+			/**
+			 * Seed of the random numbers, the same seed generates the same sequence.
+			 */
+			unsigned int seed = 42;
+		};
+
+		/**
+		 * Constructor.
+		 *
+		 * \param[in] c Calibration data of the cameras.
+		 * \param[in] settings Settings of the generated sequence.
+		 */
+		Generator(const Calibration &c, const Settings &settings);
+
+		/**
+		 * Create trajectories of the kind given in the settings. The markers are placed randomly in front of the cameras,
+		 * so that they are visible and separated from each other in both images of the first frame.
+		 *
+		 * \returns The positions of the markers in the world coordinate system.
+		 */
+		PointCloudSequence createTrajectories() const;
+
+		/**
+		 * Read trajectories from a file in the format of the result file. Each line contains the frame, the marker
+		 * and the coordinates of the marker in the world coordinate system.
+		 *
+		 * \param[in] file The file to read the trajectories from.
+		 * \returns The positions of the markers.
+		 */
+		static PointCloudSequence readTrajectories(const std::string &file);
+
+		/**
+		 * Render the trajectories and write them as a sequence into a folder. The ground truth positions are written to
+		 * Constants::groundTruthFile in the folder.
+		 *
+		 * \param[in] folder The sequence folder.
+		 * \param[in] trajectories The positions of the markers in the world coordinate system.
+		 * \param[in] cacheFile Frame cache file with the undistorted images to create for the sequence, no cache is created if it is empty.
+		 */
+		void operator()(const std::string &folder, const PointCloudSequence &trajectories, const std::string &cacheFile = std::string()) const;
+
+		/**
+		 * Write synthetic calibration data of a stereo rig with slightly converging cameras into a folder.
+		 *
+		 * \param[in] folder The folder for the calibration data.
+		 * \param[in] frameSize Size of the images, the principal points are at their centers.
+		 */
+		static void writeCalibration(const std::string &folder, const cv::Size &frameSize);
+
+	private:
+		/**
+		 * Assignment operator. It is disabled as it is not possible to assign constant values.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		Generator & operator=(const Generator &other);
+
+		/**
+		 * Project the positions of the markers of a frame into both cameras.
+		 *
+		 * \param[in] positions The positions of the markers in the world coordinate system.
+		 * \param[in] numberOfMarkers Number of markers.
+		 * \param[out] undistorted The positions in the undistorted images of both cameras.
+		 * \param[out] distorted The positions in the distorted images of both cameras.
+		 */
+		void projectFrame(const cv::Point3f *positions, unsigned int numberOfMarkers, std::vector<cv::Point2f> undistorted[2], std::vector<cv::Point2f> distorted[2]) const;
+
+		/**
+		 * Render the markers into a color image as it is stored in the videos.
+		 *
+		 * \param[in] positions The positions of the markers in the distorted image.
+		 * \param[in,out] rng Random number generator for the noise.
+		 * \param[out] image The rendered image.
+		 */
+		void renderImage(const std::vector<cv::Point2f> &positions, cv::RNG &rng, cv::Mat &image) const;
+
+		/**
+		 * Calibration data of the cameras.
+		 */
+		const Calibration &calib;
+
+		/**
+		 * Settings of the generated sequence.
+		 */
+		const Settings settings;
+
+		/**
+		 * Transformation from the world coordinate system to the first camera.
+		 */
+		cv::Matx44d transWorldCamera1;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace CVLab;
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string &file) : data(nullptr), size(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {
+	// open the file
+	fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		throw "file " + file + " could not be opened.";
+	}
+
+	// get the size of the file, an empty file cannot be mapped
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		CloseHandle(fileHandle);
+		throw "could not get size of file " + file;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	if (size == 0) {
+		return;
+	}
+
+	// map the whole file copy-on-write
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (mappingHandle != nullptr) {
+		data = static_cast<char *>(MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+	}
+	if (data == nullptr) {
+		if (mappingHandle != nullptr) {
+			CloseHandle(mappingHandle);
+		}
+		CloseHandle(fileHandle);
+		throw "file " + file + " could not be mapped into memory.";
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != nullptr) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+	}
+}
+
+#else
+
+MappedFile::MappedFile(const string &file) : data(nullptr), size(0), fileDescriptor(-1) {
+	// open the file
+	fileDescriptor = open(file.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) {
+		throw "file " + file + " could not be opened.";
+	}
+
+	// get the size of the file, an empty file cannot be mapped
+	struct stat status;
+	if (fstat(fileDescriptor, &status) != 0) {
+		close(fileDescriptor);
+		throw "could not get size of file " + file;
+	}
+	size = static_cast<size_t>(status.st_size);
+	if (size == 0) {
+		return;
+	}
+
+	// map the whole file copy-on-write
+	void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapping == MAP_FAILED) {
+		close(fileDescriptor);
+		throw "file " + file + " could not be mapped into memory.";
+	}
+	data = static_cast<char *>(mapping);
+}
+
+MappedFile::~MappedFile() {
+	if (data != nullptr) {
+		munmap(data, size);
+	}
+	if (fileDescriptor >= 0) {
+		close(fileDescriptor);
+	}
+}
+
+#endif
+
+char * MappedFile::getData() const {
+	return data;
+}
+
+size_t MappedFile::getSize() const {
+	return size;
+}
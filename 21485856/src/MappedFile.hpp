@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace CVLab {
+	/**
+	 * Class for mapping a whole file into memory.
+	 * The file is mapped copy-on-write, so the mapped memory can be modified without changing the file on disk.
+	 * As the mapping belongs to exactly one object, it is not possible to copy or assign an instance.
+	 */
+	class MappedFile {
+	public:
+		/**
+		 * Constructor. Maps the given file into memory.
+		 *
+		 * \param[in] file The file to be mapped.
+		 */
+		MappedFile(const std::string &file);
+
+		/**
+		 * Destructor. Unmaps the file.
+		 */
+		~MappedFile();
+
+		/**
+		 * Get the start of the mapped file. This is a null pointer for an empty file.
+		 */
+		char * getData() const;
+
+		/**
+		 * Get the size of the mapped file in bytes.
+		 */
+		size_t getSize() const;
+
+	private:
+		/**
+		 * Copy Constructor. It is disabled as the mapping cannot be shared.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		MappedFile(const MappedFile &other);
+
+		/**
+		 * Assignment operator. It is disabled as the mapping cannot be shared.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		MappedFile & operator=(const MappedFile &other);
+
+		/**
+		 * Start of the mapped file.
+		 */
+		char *data;
+
+		/**
+		 * Size of the mapped file in bytes.
+		 */
+		size_t size;
+
+#ifdef _WIN32
+		/**
+		 * Handle of the opened file.
+		 */
+		void *fileHandle;
+
+		/**
+		 * Handle of the file mapping.
+		 */
+		void *mappingHandle;
+#else
+		/**
+		 * Descriptor of the opened file.
+		 */
+		int fileDescriptor;
+#endif
+	};
+}
\ No newline at end of file
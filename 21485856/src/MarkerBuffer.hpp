@@ -0,0 +1,266 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+
+namespace CVLab {
+	/**
+	 * Positions of a fixed number of markers for a sequence of frames. All positions are stored in one contiguous
+	 * block in frame-major order, so the markers of a frame are adjacent and the positions of a marker are strided by
+	 * the number of markers. Both orders can be accessed without copying, and the whole buffer, a frame or a marker
+	 * can be wrapped into a cv::Mat header that shares the data with the buffer.
+	 */
+	template<typename T> class MarkerBuffer {
+	public:
+		/**
+		 * Strided view on the positions of a single marker in all frames.
+		 */
+		template<typename U> class MarkerView {
+		public:
+			/**
+			 * Constructor.
+			 *
+			 * \param[in] data Pointer to the position of the marker in the first frame.
+			 * \param[in] numberOfFrames Number of frames.
+			 * \param[in] stride Distance between the positions of two consecutive frames.
+			 */
+			MarkerView(U *data, unsigned int numberOfFrames, unsigned int stride) : data(data), numberOfFrames(numberOfFrames), stride(stride) {
+			}
+
+			/**
+			 * Get the position of the marker in a frame.
+			 *
+			 * \param[in] frame Index of the frame.
+			 * \returns Reference to the position.
+			 */
+			U & operator[](unsigned int frame) const {
+				return data[static_cast<size_t>(frame) * stride];
+			}
+
+			/**
+			 * Get the number of frames.
+			 *
+			 * \returns The number of frames.
+			 */
+			unsigned int size() const {
+				return numberOfFrames;
+			}
+
+		private:
+			/**
+			 * Pointer to the position of the marker in the first frame.
+			 */
+			U *data;
+
+			/**
+			 * Number of frames.
+			 */
+			unsigned int numberOfFrames;
+
+			/**
+			 * Distance between the positions of two consecutive frames.
+			 */
+			unsigned int stride;
+		};
+
+		/**
+		 * Constructor for an empty buffer.
+		 *
+		 * \param[in] numberOfMarkers Number of markers per frame. If it is zero, it is set by the first appended frame.
+		 */
+		explicit MarkerBuffer(unsigned int numberOfMarkers = 0) : numberOfFrames(0), numberOfMarkers(numberOfMarkers) {
+		}
+
+		/**
+		 * Constructor for a buffer with default initialized positions.
+		 *
+		 * \param[in] numberOfFrames Number of frames.
+		 * \param[in] numberOfMarkers Number of markers per frame.
+		 */
+		MarkerBuffer(unsigned int numberOfFrames, unsigned int numberOfMarkers) : positions(static_cast<size_t>(numberOfFrames) * numberOfMarkers), numberOfFrames(numberOfFrames), numberOfMarkers(numberOfMarkers) {
+		}
+
+		/**
+		 * Resize the buffer. The positions of existing frames are kept if the number of markers does not change.
+		 *
+		 * \param[in] numberOfFrames Number of frames.
+		 * \param[in] numberOfMarkers Number of markers per frame.
+		 */
+		void resize(unsigned int numberOfFrames, unsigned int numberOfMarkers) {
+			positions.resize(static_cast<size_t>(numberOfFrames) * numberOfMarkers);
+			this->numberOfFrames = numberOfFrames;
+			this->numberOfMarkers = numberOfMarkers;
+		}
+
+		/**
+		 * Reserve memory for a number of frames, so appending frames up to this number does not reallocate the buffer.
+		 *
+		 * \param[in] numberOfFrames Number of frames.
+		 */
+		void reserve(unsigned int numberOfFrames) {
+			positions.reserve(static_cast<size_t>(numberOfFrames) * numberOfMarkers);
+		}
+
+		/**
+		 * Append the positions of a frame. This invalidates views and cv::Mat headers if the buffer is reallocated.
+		 *
+		 * \param[in] markers The positions of all markers in the frame.
+		 */
+		void appendFrame(const std::vector<T> &markers) {
+			if (numberOfFrames == 0 && numberOfMarkers == 0) {
+				numberOfMarkers = static_cast<unsigned int>(markers.size());
+			}
+			if (markers.size() != numberOfMarkers) {
+				throw "number of markers does not match the buffer";
+			}
+			positions.insert(positions.end(), markers.begin(), markers.end());
+			++numberOfFrames;
+		}
+
+		/**
+		 * Overwrite the positions of a frame.
+		 *
+		 * \param[in] frame Index of the frame.
+		 * \param[in] markers The positions of all markers in the frame.
+		 */
+		void setFrame(unsigned int frame, const std::vector<T> &markers) {
+			if (markers.size() != numberOfMarkers) {
+				throw "number of markers does not match the buffer";
+			}
+			std::copy(markers.begin(), markers.end(), (*this)[frame]);
+		}
+
+		/**
+		 * Copy the positions of a frame into a vector.
+		 *
+		 * \param[in] frame Index of the frame.
+		 * \returns The positions of all markers in the frame.
+		 */
+		std::vector<T> getFrame(unsigned int frame) const {
+			return std::vector<T>((*this)[frame], (*this)[frame] + numberOfMarkers);
+		}
+
+		/**
+		 * Get the positions of the markers in a frame.
+		 *
+		 * \param[in] frame Index of the frame.
+		 * \returns Pointer to the contiguous positions of the markers in the frame.
+		 */
+		T * operator[](unsigned int frame) {
+			return positions.data() + static_cast<size_t>(frame) * numberOfMarkers;
+		}
+
+		/**
+		 * Get the positions of the markers in a frame.
+		 *
+		 * \param[in] frame Index of the frame.
+		 * \returns Pointer to the contiguous positions of the markers in the frame.
+		 */
+		const T * operator[](unsigned int frame) const {
+			return positions.data() + static_cast<size_t>(frame) * numberOfMarkers;
+		}
+
+		/**
+		 * Get the positions of a marker in all frames.
+		 *
+		 * \param[in] marker Index of the marker.
+		 * \returns Strided view on the positions of the marker.
+		 */
+		MarkerView<T> getMarker(unsigned int marker) {
+			return MarkerView<T>(positions.data() + marker, numberOfFrames, numberOfMarkers);
+		}
+
+		/**
+		 * Get the positions of a marker in all frames.
+		 *
+		 * \param[in] marker Index of the marker.
+		 * \returns Strided view on the positions of the marker.
+		 */
+		MarkerView<const T> getMarker(unsigned int marker) const {
+			return MarkerView<const T>(positions.data() + marker, numberOfFrames, numberOfMarkers);
+		}
+
+		/**
+		 * Wrap the buffer into a cv::Mat header without copying. Each row holds the positions of a frame and each column
+		 * the positions of a marker. The header is invalidated if the buffer is reallocated. The header of a constant
+		 * buffer must not be used for writing.
+		 *
+		 * \returns The header with one row per frame and one column per marker.
+		 */
+		cv::Mat getMat() const {
+			return cv::Mat(numberOfFrames, numberOfMarkers, cv::DataType<T>::type, const_cast<T *>(positions.data()));
+		}
+
+		/**
+		 * Get the number of frames.
+		 *
+		 * \returns The number of frames.
+		 */
+		unsigned int getNumberOfFrames() const {
+			return numberOfFrames;
+		}
+
+		/**
+		 * Get the number of markers per frame.
+		 *
+		 * \returns The number of markers.
+		 */
+		unsigned int getNumberOfMarkers() const {
+			return numberOfMarkers;
+		}
+
+		/**
+		 * Check whether the buffer contains no frames.
+		 *
+		 * \returns True if there are no frames.
+		 */
+		bool empty() const {
+			return numberOfFrames == 0;
+		}
+
+		/**
+		 * Get the contiguous positions of all frames.
+		 *
+		 * \returns Pointer to the position of the first marker in the first frame.
+		 */
+		T * data() {
+			return positions.data();
+		}
+
+		/**
+		 * Get the contiguous positions of all frames.
+		 *
+		 * \returns Pointer to the position of the first marker in the first frame.
+		 */
+		const T * data() const {
+			return positions.data();
+		}
+
+	private:
+		/**
+		 * The positions of all markers in all frames in frame-major order.
+		 */
+		std::vector<T> positions;
+
+		/**
+		 * Number of frames.
+		 */
+		unsigned int numberOfFrames;
+
+		/**
+		 * Number of markers per frame.
+		 */
+		unsigned int numberOfMarkers;
+	};
+
+	/**
+	 * Tracked marker positions in the images of a camera.
+	 */
+	typedef MarkerBuffer<cv::Point2f> TrackBuffer;
+
+	/**
+	 * Triangulated marker positions of a sequence.
+	 */
+	typedef MarkerBuffer<cv::Point3f> PointCloudSequence;
+}
\ No newline at end of file
@@ -0,0 +1,369 @@
+#include "Pipeline.hpp"
+
+#include <future>
+#include <chrono>
+#include <exception>
+
+#include "Profiler.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+namespace {
+	/**
+	 * Adds the time of its lifetime to a counter, so the processing time of a stage can be measured without the time waiting for the queues.
+	 */
+	class BusyTimer {
+	public:
+		/**
+		 * Constructor. Starts the measurement.
+		 *
+		 * \param[in,out] counter The counter for the time in nanoseconds.
+		 */
+		BusyTimer(atomic<long long> &counter) : counter(counter), start(chrono::steady_clock::now()) {
+		}
+
+		/**
+		 * Destructor. Adds the measured time to the counter.
+		 */
+		~BusyTimer() {
+			counter += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		}
+
+	private:
+		/**
+		 * The counter for the time in nanoseconds.
+		 */
+		atomic<long long> &counter;
+
+		/**
+		 * Start of the measurement.
+		 */
+		const chrono::steady_clock::time_point start;
+	};
+
+	/**
+	 * Add the counters of a queue to the counters of the stage taking its frames from it.
+	 *
+	 * \param[in] queue An input queue of the stage.
+	 * \param[in,out] statistics The counters of the stage.
+	 */
+	template<typename T> void addQueueStatistics(const BoundedQueue<T> &queue, Pipeline::StageStatistics &statistics) {
+		statistics.queues.push_back({ queue.getCapacity(), queue.size(), queue.getMaxDepth(), queue.getAverageDepth() });
+	}
+}
+
+Pipeline::Stage::Stage() : frames(0), busyTime(0), finishTime(-1) {
+}
+
+Pipeline::Pipeline(const Calibration &c, const Tracking &track, const Triangulation &triang, size_t queueCapacity) : calib(c), track(track), triang(triang),
+	decodedFrames{ BoundedQueue<Mat>(queueCapacity), BoundedQueue<Mat>(queueCapacity) }, undistortedFrames{ BoundedQueue<Mat>(queueCapacity), BoundedQueue<Mat>(queueCapacity) },
+	cacheFrames{ BoundedQueue<Mat>(queueCapacity), BoundedQueue<Mat>(queueCapacity) }, trackedMarkers{ BoundedQueue<vector<Point2f>>(queueCapacity), BoundedQueue<vector<Point2f>>(queueCapacity) }, triangulatedFrames(queueCapacity),
+	startTime(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count()), started(false) {
+}
+
+template<typename F> void Pipeline::runStage(Stage &stage, F body) {
+	try {
+		body();
+	} catch (const string &err) {
+		fail(err);
+	} catch (const char *err) {
+		fail(err);
+	} catch (const exception &err) {
+		fail(err.what());
+	}
+	stage.finishTime = getTime();
+}
+
+void Pipeline::operator()(Sequence &sequence, ResultWriter &writer, PointCloudSequence &positions, PointCloudSequence &motion) {
+	// the queues cannot be reused
+	if (started) {
+		throw "a pipeline can only process a single sequence";
+	}
+	started = true;
+
+	// the first frame and the initial markers are taken from the sequence
+	if (!sequence.isStreaming() || (sequence.getCurrentFrame() != 0)) {
+		throw "the pipeline needs a sequence in streaming mode at its first frame";
+	}
+	const unsigned int numberOfMarkers = static_cast<unsigned int>(sequence.getMarkers(0).size());
+	positions = PointCloudSequence(numberOfMarkers);
+	positions.reserve(sequence.getNumberOfFrames());
+	motion = PointCloudSequence(numberOfMarkers);
+	motion.reserve(sequence.getNumberOfFrames());
+
+	// take the following frames from the cache or decode them in the pipeline, which then also writes the cache
+	const shared_ptr<FrameCache> cache = sequence.getCache();
+	unique_ptr<FrameCache::Writer> cacheWriter;
+	if (!cache) {
+		cacheWriter = sequence.detachDecoding();
+	}
+	const bool undistortImages = sequence.hasUndistortedImages();
+	const bool cacheImages = static_cast<bool>(cacheWriter);
+
+	// start all stages except writing on separate threads, the first frames stay valid as the sequence is not advanced
+	startTime = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	vector<future<void>> stages;
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		if (cache) {
+			stages.push_back(async(launch::async, [this, camera, &cache]() { runStage(decodeStage[camera], [&]() { readCache(*cache, camera); }); }));
+		} else {
+			stages.push_back(async(launch::async, [this, camera, &sequence]() { runStage(decodeStage[camera], [&]() { decode(sequence, camera); }); }));
+			stages.push_back(async(launch::async, [this, camera, undistortImages, cacheImages]() { runStage(undistortStage[camera], [&]() { undistort(camera, undistortImages, cacheImages); }); }));
+		}
+		const Mat &firstFrame = sequence.getFrame(camera, 0);
+		const vector<Point2f> markers = sequence.getMarkers(camera);
+		stages.push_back(async(launch::async, [this, camera, &firstFrame, markers, undistortImages]() { runStage(trackStage[camera], [&]() { trackMarkers(camera, firstFrame, markers, !undistortImages); }); }));
+	}
+	if (cacheWriter) {
+		stages.push_back(async(launch::async, [this, &cacheWriter]() { runStage(cacheStage, [&]() { writeCache(*cacheWriter); }); }));
+	}
+	stages.push_back(async(launch::async, [this]() { runStage(triangulationStage, [this]() { triangulate(); }); }));
+
+	// write on this thread, as the writer may only be used by a single thread
+	runStage(writeStage, [&]() { write(writer, positions, motion); });
+	for (auto &stage : stages) {
+		stage.get();
+	}
+
+	// report the first error of any stage
+	if (!error.empty()) {
+		throw error;
+	}
+}
+
+vector<Pipeline::StageStatistics> Pipeline::getStatistics() const {
+	const long long now = getTime();
+	auto makeStatistics = [now](const string &name, const Stage &stage) {
+		StageStatistics statistics = StageStatistics();
+		statistics.name = name;
+		statistics.frames = stage.frames;
+		statistics.busyTime = stage.busyTime * 1e-9;
+		const long long finishTime = stage.finishTime;
+		statistics.elapsedTime = ((finishTime < 0) ? now : finishTime) * 1e-9;
+		return statistics;
+	};
+
+	// collect the counters in the order of the pipeline
+	vector<StageStatistics> result;
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		result.push_back(makeStatistics("decode camera " + to_string(camera + 1), decodeStage[camera]));
+	}
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		result.push_back(makeStatistics("undistort camera " + to_string(camera + 1), undistortStage[camera]));
+		addQueueStatistics(decodedFrames[camera], result.back());
+	}
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		result.push_back(makeStatistics("track camera " + to_string(camera + 1), trackStage[camera]));
+		addQueueStatistics(undistortedFrames[camera], result.back());
+	}
+	result.push_back(makeStatistics("write cache", cacheStage));
+	addQueueStatistics(cacheFrames[0], result.back());
+	addQueueStatistics(cacheFrames[1], result.back());
+	result.push_back(makeStatistics("triangulate", triangulationStage));
+	addQueueStatistics(trackedMarkers[0], result.back());
+	addQueueStatistics(trackedMarkers[1], result.back());
+	result.push_back(makeStatistics("write", writeStage));
+	addQueueStatistics(triangulatedFrames, result.back());
+
+	return result;
+}
+
+void Pipeline::decode(Sequence &sequence, unsigned int camera) {
+	PROFILE_THREAD("decode " + to_string(camera + 1));
+
+	// decode the frames after the first one, which has been decoded by the sequence
+	for (unsigned int frame = 1; frame < sequence.getNumberOfFrames(); ++frame) {
+		Mat gray;
+		{
+			BusyTimer timer(decodeStage[camera].busyTime);
+			if (!sequence.decodeFrame(camera, gray)) {
+				break;
+			}
+		}
+		++decodeStage[camera].frames;
+		if (!decodedFrames[camera].push(move(gray))) {
+			return;
+		}
+	}
+	decodedFrames[camera].close();
+}
+
+void Pipeline::readCache(const FrameCache &cache, unsigned int camera) {
+	PROFILE_THREAD("read cache " + to_string(camera + 1));
+
+	// the images reference the mapped cache file, so nothing is copied
+	for (unsigned int frame = 1; frame < cache.getNumberOfFrames(); ++frame) {
+		Mat image;
+		{
+			BusyTimer timer(decodeStage[camera].busyTime);
+			image = cache.getFrame(camera, frame);
+		}
+		++decodeStage[camera].frames;
+		if (!undistortedFrames[camera].push(move(image))) {
+			return;
+		}
+	}
+	undistortedFrames[camera].close();
+}
+
+void Pipeline::undistort(unsigned int camera, bool undistortImages, bool cacheImages) {
+	PROFILE_THREAD("undistort " + to_string(camera + 1));
+
+	Mat frame;
+	while (decodedFrames[camera].pop(frame)) {
+		// undistort the frame with the cached remap tables or pass it on
+		Mat undistorted;
+		{
+			BusyTimer timer(undistortStage[camera].busyTime);
+			if (undistortImages) {
+				calib.undistortImage(camera, frame, undistorted);
+			} else {
+				undistorted = frame;
+			}
+		}
+		++undistortStage[camera].frames;
+
+		// the cache and the tracking share the image, as neither of them modifies it
+		if (cacheImages && !cacheFrames[camera].push(undistorted)) {
+			return;
+		}
+		if (!undistortedFrames[camera].push(move(undistorted))) {
+			return;
+		}
+	}
+	if (cacheImages) {
+		cacheFrames[camera].close();
+	}
+	undistortedFrames[camera].close();
+}
+
+void Pipeline::writeCache(FrameCache::Writer &writer) {
+	PROFILE_THREAD("write cache");
+
+	// an incomplete cache file is removed by the writer
+	Mat frames[2];
+	for (;;) {
+		const bool read1 = cacheFrames[0].pop(frames[0]);
+		const bool read2 = cacheFrames[1].pop(frames[1]);
+		if (!read1 || !read2) {
+			if (read1 != read2) {
+				throw "both videos have different number of frames";
+			}
+			break;
+		}
+		{
+			BusyTimer timer(cacheStage.busyTime);
+			writer.write(frames[0], frames[1]);
+		}
+		++cacheStage.frames;
+	}
+}
+
+void Pipeline::trackMarkers(unsigned int camera, const Mat &firstFrame, const vector<Point2f> &markers, bool undistortMarkers) {
+	PROFILE_THREAD("track " + to_string(camera + 1));
+
+	// start tracking at the first frame
+	Tracking::State state;
+	vector<Point2f> positions;
+	{
+		BusyTimer timer(trackStage[camera].busyTime);
+		track.start(firstFrame, markers, state);
+		positions = state.getMarkers();
+		if (undistortMarkers) {
+			calib.undistortPoints(camera, positions, positions);
+		}
+	}
+	++trackStage[camera].frames;
+	if (!trackedMarkers[camera].push(positions)) {
+		return;
+	}
+
+	// and track the markers from frame to frame
+	Mat frame;
+	while (undistortedFrames[camera].pop(frame)) {
+		{
+			BusyTimer timer(trackStage[camera].busyTime);
+			positions = track.step(frame, state);
+			if (undistortMarkers) {
+				calib.undistortPoints(camera, positions, positions);
+			}
+		}
+		++trackStage[camera].frames;
+		if (!trackedMarkers[camera].push(positions)) {
+			return;
+		}
+	}
+	trackedMarkers[camera].close();
+}
+
+void Pipeline::triangulate() {
+	PROFILE_THREAD("triangulate");
+
+	vector<Point2f> markers[2];
+	vector<Point3f> reference;
+	for (;;) {
+		// get the marker positions of the next frame of both cameras
+		const bool read1 = trackedMarkers[0].pop(markers[0]);
+		const bool read2 = trackedMarkers[1].pop(markers[1]);
+		if (!read1 || !read2) {
+			if (read1 != read2) {
+				throw "both videos have different number of frames";
+			}
+			break;
+		}
+
+		// triangulate and relate the positions to the first frame in the same pass
+		TriangulatedFrame frame;
+		{
+			BusyTimer timer(triangulationStage.busyTime);
+			frame.positions = triang(markers[0], markers[1], reference, frame.motion);
+			if (reference.empty()) {
+				reference = frame.positions;
+			}
+		}
+		++triangulationStage.frames;
+		if (!triangulatedFrames.push(move(frame))) {
+			return;
+		}
+	}
+	triangulatedFrames.close();
+}
+
+void Pipeline::write(ResultWriter &writer, PointCloudSequence &positions, PointCloudSequence &motion) {
+	TriangulatedFrame frame;
+	while (triangulatedFrames.pop(frame)) {
+		PROFILE_COUNTER("queued triangulated frames", triangulatedFrames.size());
+		{
+			BusyTimer timer(writeStage.busyTime);
+			positions.appendFrame(frame.positions);
+			motion.appendFrame(frame.motion);
+			writer.write(frame.motion);
+		}
+		++writeStage.frames;
+	}
+}
+
+void Pipeline::fail(const string &err) {
+	// keep the first error, the following ones are usually caused by it
+	{
+		lock_guard<mutex> lock(errorMutex);
+		if (error.empty()) {
+			error = err;
+		}
+	}
+
+	// and stop all stages
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		decodedFrames[camera].abort();
+		undistortedFrames[camera].abort();
+		cacheFrames[camera].abort();
+		trackedMarkers[camera].abort();
+	}
+	triangulatedFrames.abort();
+}
+
+long long Pipeline::getTime() const {
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count() - startTime;
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include "Calibration.hpp"
+#include "Sequence.hpp"
+#include "FrameCache.hpp"
+#include "Tracking.hpp"
+#include "Triangulation.hpp"
+#include "ResultWriter.hpp"
+#include "BoundedQueue.hpp"
+#include "MarkerBuffer.hpp"
+#include "Constants.hpp"
+
+namespace CVLab {
+	/**
+	 * Executor processing a sequence as a pipeline of stages which run concurrently. Decoding, undistortion and
+	 * tracking run separately for each camera, followed by triangulation and writing of the result. Frames loaded
+	 * from the frame cache of the sequence skip the undistortion, otherwise the frame cache is written by a separate
+	 * stage if the sequence writes one. The stages are
+	 * connected by bounded queues, so each frame is passed on as soon as it has been processed and a fast stage
+	 * cannot run ahead of a slow one by more than the capacity of the queues. Each stage counts its frames and
+	 * its processing time, and each queue its depth, so the slowest stage can be identified.
+	 * A pipeline processes a single sequence.
+	 */
+	class Pipeline {
+	public:
+		/**
+		 * Counters of a queue between two stages.
+		 */
+		struct QueueStatistics {
+			/**
+			 * Capacity of the queue.
+			 */
+			size_t capacity;
+
+			/**
+			 * Current number of frames in the queue.
+			 */
+			size_t depth;
+
+			/**
+			 * Largest number of frames that have been in the queue.
+			 */
+			size_t maxDepth;
+
+			/**
+			 * Average number of frames in the queue when a frame was appended.
+			 */
+			double averageDepth;
+		};
+
+		/**
+		 * Counters of a stage.
+		 */
+		struct StageStatistics {
+			/**
+			 * Name of the stage.
+			 */
+			std::string name;
+
+			/**
+			 * Number of frames processed by the stage.
+			 */
+			unsigned int frames;
+
+			/**
+			 * Time in seconds the stage spent processing frames, not counting the time waiting for the queues.
+			 */
+			double busyTime;
+
+			/**
+			 * Time in seconds from the start of the pipeline until the stage finished or until now if it is still running.
+			 */
+			double elapsedTime;
+
+			/**
+			 * Counters of the queues the stage takes its frames from, one for each camera if the stage combines both cameras.
+			 * It is empty for the first stages.
+			 */
+			std::vector<QueueStatistics> queues;
+		};
+
+		/**
+		 * Constructor.
+		 *
+		 * \param[in] c Calibration data.
+		 * \param[in] track The tracking functor.
+		 * \param[in] triang The triangulation functor.
+		 * \param[in] queueCapacity Number of frames each queue between two stages can hold.
+		 */
+		Pipeline(const Calibration &c, const Tracking &track, const Triangulation &triang, size_t queueCapacity = Constants::pipelineQueueCapacity);
+
+		/**
+		 * Process the sequence. It must be in streaming mode and must not have been advanced, the following frames are
+		 * taken from its cache or decoded by the pipeline after detaching the decoding from the sequence. If the images
+		 * of the sequence are not undistorted, the tracked positions are undistorted. The motion of each frame is passed
+		 * to the writer as soon as it has been calculated.
+		 *
+		 * \param[in,out] sequence The sequence in streaming mode at its first frame.
+		 * \param[in] writer The writer for the motion of the markers.
+		 * \param[out] positions Buffer with the triangulated marker positions for each frame.
+		 * \param[out] motion Buffer with the motion of the markers for each frame.
+		 */
+		void operator()(Sequence &sequence, ResultWriter &writer, PointCloudSequence &positions, PointCloudSequence &motion);
+
+		/**
+		 * Get the counters of all stages. This can also be called from another thread while the pipeline is running.
+		 *
+		 * \returns The counters of the stages in the order of the pipeline.
+		 */
+		std::vector<StageStatistics> getStatistics() const;
+
+	private:
+		/**
+		 * Counters of a stage which are updated while the stage is running.
+		 */
+		struct Stage {
+			/**
+			 * Constructor.
+			 */
+			Stage();
+
+			/**
+			 * Number of processed frames.
+			 */
+			std::atomic<unsigned int> frames;
+
+			/**
+			 * Processing time in nanoseconds.
+			 */
+			std::atomic<long long> busyTime;
+
+			/**
+			 * Time in nanoseconds from the start of the pipeline until the stage finished, or -1 while it is running.
+			 */
+			std::atomic<long long> finishTime;
+		};
+
+		/**
+		 * Triangulated marker positions of a frame and their motion.
+		 */
+		struct TriangulatedFrame {
+			/**
+			 * Triangulated marker positions.
+			 */
+			std::vector<cv::Point3f> positions;
+
+			/**
+			 * Motion of the markers relative to the first frame.
+			 */
+			std::vector<cv::Point3f> motion;
+		};
+
+		/**
+		 * Copy constructor. It is disabled as the queues cannot be shared.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		Pipeline(const Pipeline &other);
+
+		/**
+		 * Assignment operator. It is disabled as it is not possible to assign constant values.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		Pipeline & operator=(const Pipeline &other);
+
+		/**
+		 * Decode the frames of a camera after the first one and convert them to grayscale.
+		 *
+		 * \param[in,out] sequence The sequence with detached decoding.
+		 * \param[in] camera Index of the camera.
+		 */
+		void decode(Sequence &sequence, unsigned int camera);
+
+		/**
+		 * Pass the frames of a camera after the first one from the cache on to the tracking, as they have already been preprocessed.
+		 *
+		 * \param[in] cache The cache of the sequence.
+		 * \param[in] camera Index of the camera.
+		 */
+		void readCache(const FrameCache &cache, unsigned int camera);
+
+		/**
+		 * Undistort the frames of a camera if the images are undistorted, otherwise pass them on.
+		 *
+		 * \param[in] camera Index of the camera.
+		 * \param[in] undistortImages Flag indicating whether the images are undistorted.
+		 * \param[in] cacheImages Flag indicating whether the frames are also passed on for writing the cache.
+		 */
+		void undistort(unsigned int camera, bool undistortImages, bool cacheImages);
+
+		/**
+		 * Write the frames of both cameras to the cache file.
+		 *
+		 * \param[in,out] writer The writer of the cache file.
+		 */
+		void writeCache(FrameCache::Writer &writer);
+
+		/**
+		 * Track the markers in the frames of a camera.
+		 *
+		 * \param[in] camera Index of the camera.
+		 * \param[in] firstFrame The first frame of the camera.
+		 * \param[in] markers The initial marker positions in the first frame.
+		 * \param[in] undistortMarkers Flag indicating whether the tracked positions are undistorted, as the images are not.
+		 */
+		void trackMarkers(unsigned int camera, const cv::Mat &firstFrame, const std::vector<cv::Point2f> &markers, bool undistortMarkers);
+
+		/**
+		 * Triangulate the tracked marker positions of both cameras and calculate their motion.
+		 */
+		void triangulate();
+
+		/**
+		 * Collect the results and pass the motion to the writer.
+		 *
+		 * \param[in] writer The writer for the motion of the markers.
+		 * \param[out] positions Buffer with the triangulated marker positions for each frame.
+		 * \param[out] motion Buffer with the motion of the markers for each frame.
+		 */
+		void write(ResultWriter &writer, PointCloudSequence &positions, PointCloudSequence &motion);
+
+		/**
+		 * Run a stage and record when it finished. An error stops all stages.
+		 *
+		 * \param[in] stage The counters of the stage.
+		 * \param[in] body The function executing the stage.
+		 */
+		template<typename F> void runStage(Stage &stage, F body);
+
+		/**
+		 * Stop all stages after an error. Only the first error is kept.
+		 *
+		 * \param[in] err The error message.
+		 */
+		void fail(const std::string &err);
+
+		/**
+		 * Get the time since the start of the pipeline.
+		 *
+		 * \returns The time in nanoseconds.
+		 */
+		long long getTime() const;
+
+		/**
+		 * Calibration data.
+		 */
+		const Calibration &calib;
+
+		/**
+		 * The tracking functor.
+		 */
+		const Tracking &track;
+
+		/**
+		 * The triangulation functor.
+		 */
+		const Triangulation &triang;
+
+		/**
+		 * Decoded grayscale frames of both cameras.
+		 */
+		BoundedQueue<cv::Mat> decodedFrames[2];
+
+		/**
+		 * Undistorted frames of both cameras.
+		 */
+		BoundedQueue<cv::Mat> undistortedFrames[2];
+
+		/**
+		 * Undistorted frames of both cameras for writing the cache.
+		 */
+		BoundedQueue<cv::Mat> cacheFrames[2];
+
+		/**
+		 * Tracked marker positions of both cameras.
+		 */
+		BoundedQueue<std::vector<cv::Point2f>> trackedMarkers[2];
+
+		/**
+		 * Triangulated marker positions and their motion.
+		 */
+		BoundedQueue<TriangulatedFrame> triangulatedFrames;
+
+		/**
+		 * Counters of the decoding stages.
+		 */
+		Stage decodeStage[2];
+
+		/**
+		 * Counters of the undistortion stages.
+		 */
+		Stage undistortStage[2];
+
+		/**
+		 * Counters of the tracking stages.
+		 */
+		Stage trackStage[2];
+
+		/**
+		 * Counters of the stage writing the cache.
+		 */
+		Stage cacheStage;
+
+		/**
+		 * Counters of the triangulation stage.
+		 */
+		Stage triangulationStage;
+
+		/**
+		 * Counters of the writing stage.
+		 */
+		Stage writeStage;
+
+		/**
+		 * Start time of the pipeline in nanoseconds of the steady clock.
+		 */
+		std::atomic<long long> startTime;
+
+		/**
+		 * Flag indicating that the pipeline has been run.
+		 */
+		bool started;
+
+		/**
+		 * The first error of a stage.
+		 */
+		std::string error;
+
+		/**
+		 * Mutex for setting the error.
+		 */
+		std::mutex errorMutex;
+	};
+}
\ No newline at end of file
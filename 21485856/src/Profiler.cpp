@@ -0,0 +1,286 @@
+#include "Profiler.hpp"
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+#include "tools.hpp"
+
+using namespace CVLab;
+using namespace std;
+
+namespace {
+	/**
+	 * An event with a duration.
+	 */
+	struct Event {
+		/**
+		 * Name of the event.
+		 */
+		const char *name;
+
+		/**
+		 * Start time in nanoseconds.
+		 */
+		int64_t start;
+
+		/**
+		 * Duration in nanoseconds.
+		 */
+		int64_t duration;
+	};
+
+	/**
+	 * A value of a counter.
+	 */
+	struct Counter {
+		/**
+		 * Name of the counter.
+		 */
+		const char *name;
+
+		/**
+		 * Time of the value in nanoseconds.
+		 */
+		int64_t time;
+
+		/**
+		 * The value.
+		 */
+		double value;
+	};
+
+	/**
+	 * The events and counters recorded by a thread. The mutex is only contended while the buffers are read.
+	 */
+	struct ThreadBuffer {
+		/**
+		 * Index of the thread in the trace.
+		 */
+		unsigned int id;
+
+		/**
+		 * Name of the thread.
+		 */
+		string name;
+
+		/**
+		 * The events of the thread.
+		 */
+		vector<Event> events;
+
+		/**
+		 * The counter values recorded by the thread.
+		 */
+		vector<Counter> counters;
+
+		/**
+		 * Mutex for the data of the thread.
+		 */
+		mutex bufferMutex;
+	};
+
+	/**
+	 * The buffers of all threads, they are kept after the threads have finished.
+	 */
+	vector<shared_ptr<ThreadBuffer>> buffers;
+
+	/**
+	 * Mutex for the list of buffers.
+	 */
+	mutex buffersMutex;
+
+	/**
+	 * Time all events are related to in the trace.
+	 */
+	const int64_t startTime = Profiler::now();
+
+	/**
+	 * Get the buffer of the current thread and create it on first use.
+	 *
+	 * \returns The buffer.
+	 */
+	ThreadBuffer & getThreadBuffer() {
+		thread_local ThreadBuffer *buffer = nullptr;
+		if (buffer == nullptr) {
+			shared_ptr<ThreadBuffer> created = make_shared<ThreadBuffer>();
+			lock_guard<mutex> lock(buffersMutex);
+			created->id = static_cast<unsigned int>(buffers.size()) + 1;
+			created->name = "thread " + to_string(created->id);
+			buffers.push_back(created);
+			buffer = created.get();
+		}
+		return *buffer;
+	}
+
+	/**
+	 * Write a string as JSON string.
+	 *
+	 * \param[in,out] out The stream to write to.
+	 * \param[in] str The string.
+	 */
+	void writeJsonString(ostream &out, const string &str) {
+		out << '"';
+		for (char c : str) {
+			if ((c == '"') || (c == '\\')) {
+				out << '\\' << c;
+			} else if (static_cast<unsigned char>(c) >= 0x20) {
+				out << c;
+			}
+		}
+		out << '"';
+	}
+
+	/**
+	 * Get a percentile of sorted values with the nearest-rank method.
+	 *
+	 * \param[in] values The sorted values, there must be at least one.
+	 * \param[in] p The percentile in the range (0, 1].
+	 * \returns The value at the percentile.
+	 */
+	int64_t getPercentile(const vector<int64_t> &values, double p) {
+		const size_t rank = static_cast<size_t>(ceil(p * values.size()));
+		return values[min(max(rank, size_t(1)), values.size()) - 1];
+	}
+}
+
+void Profiler::recordEvent(const char *name, int64_t start, int64_t end) {
+	ThreadBuffer &buffer = getThreadBuffer();
+	lock_guard<mutex> lock(buffer.bufferMutex);
+	buffer.events.push_back({ name, start, end - start });
+}
+
+void Profiler::recordCounter(const char *name, double value) {
+	const int64_t time = now();
+	ThreadBuffer &buffer = getThreadBuffer();
+	lock_guard<mutex> lock(buffer.bufferMutex);
+	buffer.counters.push_back({ name, time, value });
+}
+
+void Profiler::setThreadName(const string &name) {
+	ThreadBuffer &buffer = getThreadBuffer();
+	lock_guard<mutex> lock(buffer.bufferMutex);
+	buffer.name = name;
+}
+
+void Profiler::writeTrace(const string &file) {
+	ofstream out(file, ios_base::out | ios_base::trunc);
+	if (!out.is_open()) {
+		throw "could not open trace file " + file + " for writing";
+	}
+
+	// the timestamps of trace events are given in microseconds
+	out << fixed << setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	const auto separate = [&]() {
+		out << (first ? "\n" : ",\n");
+		first = false;
+	};
+	lock_guard<mutex> lock(buffersMutex);
+	for (const auto &buffer : buffers) {
+		lock_guard<mutex> bufferLock(buffer->bufferMutex);
+		separate();
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":";
+		writeJsonString(out, buffer->name);
+		out << "}}";
+		for (const auto &event : buffer->events) {
+			separate();
+			out << "{\"name\":";
+			writeJsonString(out, event.name);
+			out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << (event.start - startTime) / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+		}
+		for (const auto &counter : buffer->counters) {
+			separate();
+			out << "{\"name\":";
+			writeJsonString(out, counter.name);
+			out << ",\"ph\":\"C\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << (counter.time - startTime) / 1000.0 << ",\"args\":{\"value\":" << counter.value << "}}";
+		}
+	}
+	out << "\n]}\n";
+
+	out.close();
+	if (out.fail()) {
+		throw "could not write trace file " + file;
+	}
+}
+
+void Profiler::logSummary() {
+	// collect the durations of the events and the values of the counters by name
+	map<string, vector<int64_t>> durations;
+	map<string, vector<double>> counters;
+	{
+		lock_guard<mutex> lock(buffersMutex);
+		for (const auto &buffer : buffers) {
+			lock_guard<mutex> bufferLock(buffer->bufferMutex);
+			for (const auto &event : buffer->events) {
+				durations[event.name].push_back(event.duration);
+			}
+			for (const auto &counter : buffer->counters) {
+				counters[counter.name].push_back(counter.value);
+			}
+		}
+	}
+
+	// list the events with the highest total time first
+	struct Row {
+		string name;
+		size_t count;
+		double total, mean, p50, p90, p99, maximum;
+	};
+	vector<Row> rows;
+	for (auto &entry : durations) {
+		vector<int64_t> &values = entry.second;
+		sort(values.begin(), values.end());
+		double total = 0;
+		for (int64_t value : values) {
+			total += value;
+		}
+		rows.push_back({ entry.first, values.size(), total / 1e6, total / values.size() / 1e6, getPercentile(values, 0.5) / 1e6, getPercentile(values, 0.9) / 1e6,
+			getPercentile(values, 0.99) / 1e6, values.back() / 1e6 });
+	}
+	sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) { return a.total > b.total; });
+
+	// and log them as table with times in milliseconds
+	size_t nameWidth = 7;
+	for (const auto &entry : durations) {
+		nameWidth = max(nameWidth, entry.first.size());
+	}
+	for (const auto &entry : counters) {
+		nameWidth = max(nameWidth, entry.first.size());
+	}
+	ostringstream header;
+	header << left << setw(nameWidth) << "event" << right << setw(10) << "count" << setw(12) << "total ms" << setw(10) << "mean ms"
+		<< setw(10) << "p50 ms" << setw(10) << "p90 ms" << setw(10) << "p99 ms" << setw(10) << "max ms";
+	logMessage(header.str());
+	for (const auto &row : rows) {
+		ostringstream line;
+		line << fixed << setprecision(3) << left << setw(nameWidth) << row.name << right << setw(10) << row.count << setw(12) << row.total << setw(10) << row.mean
+			<< setw(10) << row.p50 << setw(10) << row.p90 << setw(10) << row.p99 << setw(10) << row.maximum;
+		logMessage(line.str());
+	}
+
+	// the counters are summarized by their mean and maximum value
+	if (!counters.empty()) {
+		ostringstream counterHeader;
+		counterHeader << left << setw(nameWidth) << "counter" << right << setw(10) << "samples" << setw(12) << "mean" << setw(10) << "max";
+		logMessage(counterHeader.str());
+		for (const auto &entry : counters) {
+			const vector<double> &values = entry.second;
+			double sum = 0;
+			for (double value : values) {
+				sum += value;
+			}
+			ostringstream line;
+			line << fixed << setprecision(2) << left << setw(nameWidth) << entry.first << right << setw(10) << values.size() << setw(12) << sum / values.size()
+				<< setw(10) << *max_element(values.begin(), values.end());
+			logMessage(line.str());
+		}
+	}
+}
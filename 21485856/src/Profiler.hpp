@@ -0,0 +1,139 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+namespace CVLab {
+	/**
+	 * Collector of timing events and counters for profiling. Each thread records into its own buffer, so recording
+	 * never waits for other threads. The events can be written as Chrome trace events, which can be viewed with
+	 * chrome://tracing or Perfetto, and summarized per name. The events are recorded with the macros PROFILE_SCOPE,
+	 * PROFILE_COUNTER and PROFILE_THREAD, which expand to nothing unless PROFILING is defined, so the instrumented
+	 * code does not change at all in normal builds.
+	 */
+	class Profiler {
+	public:
+		/**
+		 * Timer recording an event for the time from its construction to its destruction.
+		 */
+		class ScopedTimer {
+		public:
+			/**
+			 * Constructor. Starts the timer.
+			 *
+			 * \param[in] name Name of the event. It must be a string literal, as only the pointer is stored.
+			 */
+			explicit ScopedTimer(const char *name) : name(name), start(now()) {
+			}
+
+			/**
+			 * Destructor. Records the event.
+			 */
+			~ScopedTimer() {
+				recordEvent(name, start, now());
+			}
+
+		private:
+			/**
+			 * Copy constructor. It is disabled as an event must only be recorded once.
+			 *
+			 * \param[in] other The object to copy the data from.
+			 */
+			ScopedTimer(const ScopedTimer &other);
+
+			/**
+			 * Assignment operator. It is disabled as an event must only be recorded once.
+			 *
+			 * \param[in] other The other object that should be assigned to this one.
+			 */
+			ScopedTimer & operator=(const ScopedTimer &other);
+
+			/**
+			 * Name of the event.
+			 */
+			const char *name;
+
+			/**
+			 * Start time of the event in nanoseconds.
+			 */
+			const int64_t start;
+		};
+
+		/**
+		 * Get the current time of the clock used for all events.
+		 *
+		 * \returns The time in nanoseconds.
+		 */
+		static int64_t now() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		/**
+		 * Record an event of the current thread.
+		 *
+		 * \param[in] name Name of the event. It must be a string literal, as only the pointer is stored.
+		 * \param[in] start Start time of the event in nanoseconds.
+		 * \param[in] end End time of the event in nanoseconds.
+		 */
+		static void recordEvent(const char *name, int64_t start, int64_t end);
+
+		/**
+		 * Record the current value of a counter.
+		 *
+		 * \param[in] name Name of the counter. It must be a string literal, as only the pointer is stored.
+		 * \param[in] value The value of the counter.
+		 */
+		static void recordCounter(const char *name, double value);
+
+		/**
+		 * Set the name of the current thread shown in the trace.
+		 *
+		 * \param[in] name Name of the thread.
+		 */
+		static void setThreadName(const std::string &name);
+
+		/**
+		 * Write all recorded events and counters as Chrome trace events in JSON format.
+		 *
+		 * \param[in] file The file to write the trace to.
+		 */
+		static void writeTrace(const std::string &file);
+
+		/**
+		 * Log a table with the number, the total time and the percentiles of the duration of the events of each name,
+		 * followed by the mean and maximum value of each counter.
+		 */
+		static void logSummary();
+
+	private:
+		/**
+		 * Constructor. It is disabled as the profiler only has static functions.
+		 */
+		Profiler();
+	};
+}
+
+#ifdef PROFILING
+#define PROFILE_CONCAT_NAME(a, b) a##b
+#define PROFILE_UNIQUE_NAME(a, b) PROFILE_CONCAT_NAME(a, b)
+
+/**
+ * Record an event with the given name for the rest of the enclosing scope.
+ */
+#define PROFILE_SCOPE(name) CVLab::Profiler::ScopedTimer PROFILE_UNIQUE_NAME(profileScope, __LINE__)(name)
+
+/**
+ * Record the current value of a counter, the value is not evaluated if profiling is disabled.
+ */
+#define PROFILE_COUNTER(name, value) CVLab::Profiler::recordCounter(name, static_cast<double>(value))
+
+/**
+ * Set the name of the current thread shown in the trace.
+ */
+#define PROFILE_THREAD(name) CVLab::Profiler::setThreadName(name)
+#else
+#define PROFILE_SCOPE(name) do {} while (false)
+#define PROFILE_COUNTER(name, value) do {} while (false)
+#define PROFILE_THREAD(name) do {} while (false)
+#endif
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "ResultWriter.hpp"
+
+#include <charconv>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+
+#include "Profiler.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+namespace {
+	/**
+	 * Size of the header of a NumPy array including the magic string, so the data is aligned to 64 bytes.
+	 */
+	const size_t npyHeaderSize = 128;
+
+	/**
+	 * Wait a little while polling the ring of frame slots. The thread yields first and sleeps if it has to wait longer.
+	 *
+	 * \param[in,out] idle Number of times the thread has waited without progress.
+	 */
+	void backoff(unsigned int &idle) {
+		if (idle++ < Constants::resultWriterSpins) {
+			this_thread::yield();
+		} else {
+			this_thread::sleep_for(chrono::microseconds(Constants::resultWriterSleep));
+		}
+	}
+}
+
+ResultWriter::ResultWriter(const string &file, unsigned int numberOfMarkers, int precision) : file(file), numberOfMarkers(numberOfMarkers), precision(precision),
+	npy((file.size() >= 4) && (file.compare(file.size() - 4, 4, ".npy") == 0)), bufferPos(nullptr), maxLineLength(0), writtenFrames(0), head(0), tail(0), finished(false), failed(false) {
+	// check precision, it determines the maximum length of a line
+	if ((precision < 0) || (precision > 100)) {
+		throw "invalid precision " + to_string(precision) + " for writing result.";
+	}
+	maxLineLength = 2 * 12 + 3 * (48 + precision) + 8;
+
+	// open file for writing the result
+	output.open(file, npy ? (ios_base::out | ios_base::trunc | ios_base::binary) : (ios_base::out | ios_base::trunc));
+	if (!output.is_open()) {
+		throw "could not open file " + file + " for writing result.";
+	}
+
+	// the data of a NumPy array is written in the byte order of the machine, which has to be little endian
+	if (npy) {
+		const uint16_t byteOrder = 1;
+		if (*reinterpret_cast<const unsigned char *>(&byteOrder) != 1) {
+			throw string("writing NumPy arrays is only supported on little endian machines.");
+		}
+		writeNpyHeader();
+	}
+
+	// allocate the buffer and the frame slots and start the writing thread
+	buffer.resize(max(Constants::resultBufferSize, 2 * maxLineLength));
+	bufferPos = buffer.data();
+	slots.resize(static_cast<size_t>(Constants::resultQueueCapacity) * numberOfMarkers);
+	thread = std::thread(&ResultWriter::run, this);
+}
+
+ResultWriter::~ResultWriter() {
+	// let the writing thread finish
+	if (thread.joinable()) {
+		finished.store(true, memory_order_release);
+		thread.join();
+	}
+}
+
+void ResultWriter::write(const Point3f *positions) {
+	// the writing thread stops on errors, so report them to the producer
+	if (failed.load(memory_order_acquire)) {
+		throw error;
+	}
+	if (!thread.joinable()) {
+		throw "result writer for " + file + " has already been closed.";
+	}
+
+	// wait for a free slot
+	const size_t index = tail.load(memory_order_relaxed);
+	unsigned int idle = 0;
+	while (index - head.load(memory_order_acquire) >= Constants::resultQueueCapacity) {
+		if (failed.load(memory_order_acquire)) {
+			throw error;
+		}
+		backoff(idle);
+	}
+
+	// copy the frame into the slot and publish it
+	PROFILE_COUNTER("queued results", index - head.load(memory_order_relaxed));
+	copy(positions, positions + numberOfMarkers, slots.data() + (index % Constants::resultQueueCapacity) * numberOfMarkers);
+	tail.store(index + 1, memory_order_release);
+}
+
+void ResultWriter::write(const vector<Point3f> &positions) {
+	if (positions.size() != numberOfMarkers) {
+		throw "number of markers does not match the result writer";
+	}
+	write(positions.data());
+}
+
+void ResultWriter::close() {
+	// the final flush is the only point where the producer waits for the writing thread
+	if (thread.joinable()) {
+		finished.store(true, memory_order_release);
+		thread.join();
+	}
+	if (failed.load(memory_order_acquire)) {
+		throw error;
+	}
+}
+
+void ResultWriter::run() {
+	PROFILE_THREAD("result writer");
+	try {
+		unsigned int idle = 0;
+		for (;;) {
+			// check for finishing before getting the available frames, so no frame queued before finishing is missed
+			const size_t index = head.load(memory_order_relaxed);
+			const bool done = finished.load(memory_order_acquire);
+			if (index == tail.load(memory_order_acquire)) {
+				if (done) {
+					break;
+				}
+				backoff(idle);
+				continue;
+			}
+			idle = 0;
+
+			// write the frame and release its slot
+			writeFrame(slots.data() + (index % Constants::resultQueueCapacity) * numberOfMarkers);
+			head.store(index + 1, memory_order_release);
+		}
+
+		// write the remaining data and the final header of a NumPy array
+		flush();
+		if (npy) {
+			output.seekp(0);
+			writeNpyHeader();
+		}
+		output.close();
+		if (output.fail()) {
+			throw "could not write result to file " + file + ".";
+		}
+	} catch (const string &err) {
+		error = err;
+		failed.store(true, memory_order_release);
+	} catch (const char *err) {
+		error = err;
+		failed.store(true, memory_order_release);
+	}
+}
+
+void ResultWriter::writeFrame(const Point3f *positions) {
+	PROFILE_SCOPE("write result");
+	if (npy) {
+		// the positions are written as they are
+		output.write(reinterpret_cast<const char *>(positions), static_cast<streamsize>(numberOfMarkers) * sizeof(Point3f));
+	} else {
+		// format the lines into the buffer which is only written to the file when it is full
+		char *const end = buffer.data() + buffer.size();
+		for (unsigned int markerIdx = 0; markerIdx < numberOfMarkers; ++markerIdx) {
+			if (static_cast<size_t>(end - bufferPos) < maxLineLength) {
+				flush();
+			}
+
+			const auto &marker = positions[markerIdx];
+			bufferPos = to_chars(bufferPos, end, writtenFrames).ptr;
+			*bufferPos++ = ',';
+			bufferPos = to_chars(bufferPos, end, markerIdx).ptr;
+			for (float value : { marker.x, marker.y, marker.z }) {
+				*bufferPos++ = ',';
+				bufferPos = to_chars(bufferPos, end, value, chars_format::fixed, precision).ptr;
+			}
+			*bufferPos++ = '\n';
+		}
+	}
+	++writtenFrames;
+
+	if (output.fail()) {
+		throw "could not write result to file " + file + ".";
+	}
+}
+
+void ResultWriter::flush() {
+	output.write(buffer.data(), bufferPos - buffer.data());
+	bufferPos = buffer.data();
+}
+
+void ResultWriter::writeNpyHeader() {
+	// create the description of the array and pad it to the fixed header size
+	const string magic("\x93NUMPY\x01\x00", 8);
+	string header = "{'descr': '<f4', 'fortran_order': False, 'shape': (" + to_string(writtenFrames) + ", " + to_string(numberOfMarkers) + ", 3), }";
+	header.append(npyHeaderSize - magic.size() - 2 - header.size() - 1, ' ');
+	header.push_back('\n');
+	const uint16_t headerLength = static_cast<uint16_t>(header.size());
+
+	// write magic string, length of the description and the description
+	output.write(magic.data(), magic.size());
+	output.put(static_cast<char>(headerLength & 0xff));
+	output.put(static_cast<char>(headerLength >> 8));
+	output.write(header.data(), header.size());
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include "Constants.hpp"
+
+namespace CVLab {
+	/**
+	 * Writer for the triangulation result which writes the frames in a background thread while they are produced.
+	 * The frames are passed from the producing thread to the writing thread through a lock-free single-producer
+	 * single-consumer ring of frame slots, so writing does not block the computation unless the ring is full.
+	 * If the file name ends with .npy, the result is written as binary NumPy array of 32 bit floats with the shape
+	 * (frames, markers, 3). Otherwise a CSV file with one line per frame and marker is written.
+	 * Only one thread may write frames into an instance.
+	 */
+	class ResultWriter {
+	public:
+		/**
+		 * Constructor. Opens the file and starts the writing thread.
+		 *
+		 * \param[in] file The file to save the triangulation result to.
+		 * \param[in] numberOfMarkers Number of markers in each frame.
+		 * \param[in] precision Number of decimal places of the coordinates in a CSV file.
+		 */
+		ResultWriter(const std::string &file, unsigned int numberOfMarkers, int precision = Constants::resultPrecision);
+
+		/**
+		 * Destructor. Stops the writing thread after all queued frames have been written, errors are ignored.
+		 */
+		~ResultWriter();
+
+		/**
+		 * Queue the positions of the next frame for writing. This only waits if the ring of frame slots is full.
+		 *
+		 * \param[in] positions The positions of all markers in the frame.
+		 */
+		void write(const cv::Point3f *positions);
+
+		/**
+		 * Queue the positions of the next frame for writing. This only waits if the ring of frame slots is full.
+		 *
+		 * \param[in] positions The positions of all markers in the frame.
+		 */
+		void write(const std::vector<cv::Point3f> &positions);
+
+		/**
+		 * Wait until all queued frames have been written and close the file.
+		 */
+		void close();
+
+	private:
+		/**
+		 * Copy constructor. It is disabled as the writing thread and the file cannot be shared.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		ResultWriter(const ResultWriter &other);
+
+		/**
+		 * Assignment operator. It is disabled as the writing thread and the file cannot be shared.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		ResultWriter & operator=(const ResultWriter &other);
+
+		/**
+		 * Main loop of the writing thread. It writes all queued frames until the writer is closed.
+		 */
+		void run();
+
+		/**
+		 * Format a frame into the output buffer.
+		 *
+		 * \param[in] positions The positions of all markers in the frame.
+		 */
+		void writeFrame(const cv::Point3f *positions);
+
+		/**
+		 * Write the output buffer into the file.
+		 */
+		void flush();
+
+		/**
+		 * Write the header of a NumPy array. The header has a fixed size, so it can be rewritten with the final number of frames.
+		 */
+		void writeNpyHeader();
+
+		/**
+		 * The file to save the triangulation result to.
+		 */
+		const std::string file;
+
+		/**
+		 * Number of markers in each frame.
+		 */
+		const unsigned int numberOfMarkers;
+
+		/**
+		 * Number of decimal places of the coordinates in a CSV file.
+		 */
+		const int precision;
+
+		/**
+		 * Flag indicating whether a NumPy array is written.
+		 */
+		const bool npy;
+
+		/**
+		 * The output stream.
+		 */
+		std::ofstream output;
+
+		/**
+		 * Buffer for formatting the CSV lines.
+		 */
+		std::vector<char> buffer;
+
+		/**
+		 * Current position in the buffer.
+		 */
+		char *bufferPos;
+
+		/**
+		 * Maximum length of a CSV line.
+		 */
+		size_t maxLineLength;
+
+		/**
+		 * Number of frames that have been written.
+		 */
+		unsigned int writtenFrames;
+
+		/**
+		 * Ring of frame slots, each slot holds the positions of all markers of a frame.
+		 */
+		std::vector<cv::Point3f> slots;
+
+		/**
+		 * Number of frames taken from the ring by the writing thread.
+		 */
+		std::atomic<size_t> head;
+
+		/**
+		 * Number of frames put into the ring by the producing thread.
+		 */
+		std::atomic<size_t> tail;
+
+		/**
+		 * Flag indicating that no more frames will be queued.
+		 */
+		std::atomic<bool> finished;
+
+		/**
+		 * Flag indicating that the writing thread failed.
+		 */
+		std::atomic<bool> failed;
+
+		/**
+		 * Error message of the writing thread.
+		 */
+		std::string error;
+
+		/**
+		 * The writing thread.
+		 */
+		std::thread thread;
+	};
+}
\ No newline at end of file
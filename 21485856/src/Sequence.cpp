@@ -1,169 +1,418 @@
-#include "Sequence.hpp"
-
-#include "tools.hpp"
-#include "Constants.hpp"
-
-using namespace CVLab;
-using namespace cv;
-using namespace std;
-
-Sequence::Sequence(const string &folder, const Calibration &c) : calib(c) {
-	// read both videos
-	readVideo(folder + Constants::sequence1File, images[0], calib.getCamera1(), calib.getDistortion1());
-	readVideo(folder + Constants::sequence2File, images[1], calib.getCamera2(), calib.getDistortion2());
-
-	// check if both videos have the same amount of frames
-	if (images[0].size() != images[1].size()) {
-		throw "both videos have different number of frames";
-	}
-
-	// load marker positions for both videos
-	readMarkers(folder + Constants::markers1File, markers[0], images[0][0]);
-	readMarkers(folder + Constants::markers2File, markers[1], images[1][0]);
-
-	// check if both videos have the same amount of markers
-	if (markers[0].size() != markers[1].size()) {
-		throw "both videos have different number of markers";
-	}
-
-	// sort the markers so that they have the same ordering for both videos
-	sortMarkers();
-}
-
-Sequence::Sequence(const Sequence &other) : calib(other.calib) {
-	// loop over all cameras
-	for (unsigned int camera = 0; camera < 2; ++camera) {
-		// copy images
-		images[camera].resize(other.images[camera].size());
-		for (unsigned int frame = 0; frame < images[camera].size(); ++frame) {
-			images[camera][frame] = other.images[camera][frame].clone();
-		}
-
-		// copy marker positions
-		markers[camera] = other.markers[camera];
-	}
-}
-
-unsigned int Sequence::getNumberOfFrames() const {
-	return images[0].size();
-}
-
-const vector<Mat> & Sequence::operator[](unsigned int camera) const {
-	// check camera index
-	if (camera > 1) {
-		throw "there are only two cameras";
-	}
-
-	// return sequence of images
-	return images[camera];
-}
-
-vector<Point2f> Sequence::getMarkers(unsigned int camera) const {
-	// check camera index
-	if (camera > 1) {
-		throw "there are only two cameras";
-	}
-
-	// return marker positions
-	return markers[camera];
-}
-
-void Sequence::readVideo(const string &file, vector<Mat> &data, const Mat &K, const Mat &distortion) {
-	// open video file
-	VideoCapture vid(file);
-	if (!vid.isOpened()) {
-		throw "could not open video file " + file;
-	}
-
-	// get number of frames from the video file
-	const unsigned int numberOfFrames = static_cast<unsigned int>(vid.get(CAP_PROP_FRAME_COUNT));
-	
-	// resize vector to number of frames
-	data.clear();
-	data.resize(numberOfFrames);
-
-	// load images from video
-	for (unsigned int i = 0; i < numberOfFrames; ++i) {
-		Mat img, gray, undistorted;
-
-		// load next frame
-		vid >> img;
-
-		// convert frame to grayscale
-		cvtColor(img, gray, COLOR_BGR2GRAY);
-
-		// undistort the image
-		undistort(gray, undistorted, K, distortion);
-
-		// save the undistorted image in the vector
-		undistorted.copyTo(data[i]);
-	}
-}
-
-void Sequence::readMarkers(const string &file, vector<Point2f> &data, const Mat &firstImage) {
-	// read raw data from file
-	Mat markerData = readMatrix(file);
-
-	// check matrix dimension for validity
-	checkMatrixDimensions(markerData, -1, 2, "marker positions");
-
-	// resize vector to take marker positions
-	data.clear();
-	data.resize(markerData.rows);
-
-	// save marker positions in the vector
-	for (int i = 0; i < markerData.rows; ++i) {
-		data[i].x = markerData.at<float>(i, 0);
-		data[i].y = markerData.at<float>(i, 1);
-	}
-
-	// and refine the marker positions
-	cornerSubPix(firstImage, data, Constants::markerRefinementWindowSize, Constants::markerRefinementZeroZone, Constants::markerRefinementCriteria);
-}
-
-
-void Sequence::sortMarkers() {
-	//sort both vectors so that the positions are corresponding
-	
-	cerr << "Sequence::sortMarkers is not implemented" << endl;
-	float sourceMarker_X = markers[0][0].x;
-	float sourceMarker_Y = markers[0][0].y;
-	float targetMarker_X = markers[1][0].x;
-	float targetMarker_Y = markers[1][0].y;
-	float sectargetMarker_X = markers[1][1].x;
-	float sectargetMarker_Y = markers[1][1].y;
-	
-	Mat sourceMarker = (Mat_<float>(3, 1) << sourceMarker_X, sourceMarker_Y, 1);
-	Mat targetMarker = (Mat_<float>(3, 1) << targetMarker_X, targetMarker_Y, 1);
-	Mat sectargetMarker = (Mat_<float>(3, 1) << sectargetMarker_X, sectargetMarker_Y, 1);
-
-	//std::vector<cv::Point2f> newmarkers[2];
-	//Mat newsourceMarker = (Mat_<cv::Point_<float>>(1, 2) << newmarkers[1][0], newmarkers[1][1]);
-	//Mat newtargetMarker = (Mat_<cv::Point_<float>>(1, 2) << newmarkers[1][0], newmarkers[1][1]);
-
-	//fundamental matrix
-	Mat fundMat = calib.getFundamentalMat();
-	//Mat firstEpipolar = (sourceMarker*fundMat)*targetMarker;
-	//Mat secondEpipolar = (sourceMarker*fundMat)*sectargetMarker;
-	
-	//calculate epipolar of two camera
-	Mat firstEpipolar = (targetMarker.t()*fundMat)*sourceMarker;
-	Mat secondEpipolar = (sectargetMarker.t()*fundMat)*sourceMarker;
-	//float* firEpiVal = (float*)firstEpipolar.data;
-	bool isFirpointclose2zero = abs(*(float*)firstEpipolar.data) < abs(*(float*)secondEpipolar.data);
-	//bool isFirpointclose2zero = abs(firstEpipolar) < abs(*(float*)secondEpipolar.data);
-
-	if (!isFirpointclose2zero){
-		std::vector<cv::Point2f> newmarkers[1];
-		newmarkers[0] = markers[1];
-		markers[1][0] = markers[1][1];
-		markers[1][1] = newmarkers[0][0];
-	}
-
-	cerr << firstEpipolar << endl;
-	cerr << secondEpipolar << endl;
-
-
-	showImageMarkers(images[0][0], markers[0],"",false);
-	showImageMarkers(images[1][0], markers[1], "", false);
-}
+#include "Sequence.hpp"
+
+#include <future>
+
+#include "tools.hpp"
+#include "Constants.hpp"
+#include "Profiler.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+Sequence::Sequence(const string &folder, const Calibration &c, unsigned int window, bool undistortImages, const string &cacheFile) : calib(c), currentFrame(0), window(window), undistortImages(undistortImages), decodingDetached(false) {
+	// check window size as tracking needs at least the previous and the current frame
+	if (window == 1) {
+		throw "the window of a streaming sequence must contain at least 2 frames";
+	}
+
+	// use the cached images if they have been created from the same calibration data and videos
+	FrameCache::Key cacheKey = FrameCache::Key();
+	if (!cacheFile.empty()) {
+		cacheKey = FrameCache::createKey(calib, folder + Constants::sequence1File, folder + Constants::sequence2File, undistortImages);
+		cache = FrameCache::open(cacheFile, cacheKey);
+	}
+
+	if (cache) {
+		// reference the images in the cache
+		numberOfFrames = cache->getNumberOfFrames();
+		for (unsigned int camera = 0; camera < 2; ++camera) {
+			images[camera].resize(isStreaming() ? window : numberOfFrames);
+			for (unsigned int frame = 0; frame < (isStreaming() ? 1 : numberOfFrames); ++frame) {
+				images[camera][frame] = cache->getFrame(camera, frame);
+			}
+		}
+		if (!isStreaming()) {
+			currentFrame = numberOfFrames - 1;
+		}
+
+		// load and sort the marker positions for both videos
+		loadMarkers(folder);
+		return;
+	}
+
+	// open both videos and check if they have the same amount of frames before decoding anything
+	numberOfFrames = openVideo(folder + Constants::sequence1File, videos[0]);
+	if (openVideo(folder + Constants::sequence2File, videos[1]) != numberOfFrames) {
+		throw "both videos have different number of frames";
+	}
+
+	if (isStreaming()) {
+		// create the ring for the frames and load the first frame of both videos
+		images[0].resize(window);
+		images[1].resize(window);
+		if (!readFramePair(0)) {
+			throw "could not read first frame of the videos";
+		}
+
+		// start writing the cache file, it is completed when the last frame has been decoded
+		if (!cacheFile.empty()) {
+			cacheWriter.reset(new FrameCache::Writer(cacheFile, cacheKey, numberOfFrames, images[0][0].size()));
+			cacheWriter->write(images[0][0], images[1][0]);
+		}
+	} else {
+		// decode both videos concurrently, the second one on a separate thread, an error of either one stops the other one
+		atomic<bool> stop(false);
+		auto decoder = async(launch::async, [&]() {
+			try {
+				readVideo(videos[1], images[1], numberOfFrames, calib, 1, undistortImages, stop);
+			} catch (...) {
+				stop = true;
+				throw;
+			}
+		});
+		try {
+			readVideo(videos[0], images[0], numberOfFrames, calib, 0, undistortImages, stop);
+		} catch (...) {
+			stop = true;
+			decoder.wait();
+			throw;
+		}
+		decoder.get();
+		videos[0].release();
+		videos[1].release();
+
+		// check if both videos really had the same amount of frames
+		if (images[0].size() != images[1].size()) {
+			throw "both videos have different number of frames";
+		}
+		if (images[0].empty()) {
+			throw "the videos do not contain any frames";
+		}
+		numberOfFrames = images[0].size();
+		currentFrame = numberOfFrames - 1;
+
+		// write the images to the cache file
+		if (!cacheFile.empty()) {
+			FrameCache::Writer writer(cacheFile, cacheKey, numberOfFrames, images[0][0].size());
+			for (unsigned int frame = 0; frame < numberOfFrames; ++frame) {
+				writer.write(images[0][frame], images[1][frame]);
+			}
+		}
+	}
+
+	// load and sort the marker positions for both videos
+	loadMarkers(folder);
+}
+
+Sequence::Sequence(const Sequence &other) : calib(other.calib), numberOfFrames(other.numberOfFrames), currentFrame(other.currentFrame), window(other.window), undistortImages(other.undistortImages), decodingDetached(false) {
+	// the decoding state of the videos cannot be duplicated
+	if (other.isStreaming()) {
+		throw "a sequence in streaming mode cannot be copied";
+	}
+
+	// loop over all cameras
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		// copy images
+		images[camera].resize(other.images[camera].size());
+		for (unsigned int frame = 0; frame < images[camera].size(); ++frame) {
+			images[camera][frame] = other.images[camera][frame].clone();
+		}
+
+		// copy marker positions
+		markers[camera] = other.markers[camera];
+	}
+}
+
+unsigned int Sequence::getNumberOfFrames() const {
+	return numberOfFrames;
+}
+
+bool Sequence::isStreaming() const {
+	return window > 0;
+}
+
+bool Sequence::hasUndistortedImages() const {
+	return undistortImages;
+}
+
+bool Sequence::readNextFrame() {
+	// only possible in streaming mode
+	if (!isStreaming()) {
+		throw "the sequence is not in streaming mode";
+	}
+	if (decodingDetached) {
+		throw "the decoding of the sequence has been detached";
+	}
+
+	// check for end of sequence
+	if (currentFrame + 1 >= numberOfFrames) {
+		return false;
+	}
+
+	// reference the next frame in the cache
+	const unsigned int slot = (currentFrame + 1) % window;
+	if (cache) {
+		for (unsigned int camera = 0; camera < 2; ++camera) {
+			images[camera][slot] = cache->getFrame(camera, currentFrame + 1);
+		}
+		++currentFrame;
+		return true;
+	}
+
+	// decode next frame of both videos into the oldest position in the ring
+	if (!readFramePair(slot)) {
+		cacheWriter.reset();
+		return false;
+	}
+	++currentFrame;
+
+	// write the frame to the cache file
+	if (cacheWriter) {
+		cacheWriter->write(images[0][slot], images[1][slot]);
+		if (currentFrame + 1 == numberOfFrames) {
+			cacheWriter.reset();
+		}
+	}
+	return true;
+}
+
+unique_ptr<FrameCache::Writer> Sequence::detachDecoding() {
+	// the videos must be positioned after the first frame
+	if (!isStreaming() || (currentFrame != 0) || cache) {
+		throw "only the decoding of a sequence in streaming mode at its first frame without cache can be detached";
+	}
+	decodingDetached = true;
+	return move(cacheWriter);
+}
+
+bool Sequence::decodeFrame(unsigned int camera, Mat &image) {
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+	if (!decodingDetached) {
+		throw "the decoding of the sequence has not been detached";
+	}
+
+	// the images are undistorted by the caller if requested
+	return readFrame(videos[camera], image, calib, camera, false);
+}
+
+shared_ptr<FrameCache> Sequence::getCache() const {
+	return cache;
+}
+
+unsigned int Sequence::getCurrentFrame() const {
+	return currentFrame;
+}
+
+const Mat & Sequence::getFrame(unsigned int camera, unsigned int frame) const {
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+
+	// check frame index
+	if (frame > currentFrame) {
+		throw "frame " + to_string(frame) + " has not been loaded yet";
+	}
+
+	// return image directly or from the ring
+	if (!isStreaming()) {
+		return images[camera][frame];
+	}
+	if (currentFrame - frame >= window) {
+		throw "frame " + to_string(frame) + " is not in the window any more";
+	}
+	return images[camera][frame % window];
+}
+
+const vector<Mat> & Sequence::operator[](unsigned int camera) const {
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+
+	// the whole sequence is not available in streaming mode
+	if (isStreaming()) {
+		throw "the images of a sequence in streaming mode can only be retrieved frame by frame";
+	}
+
+	// return sequence of images
+	return images[camera];
+}
+
+vector<Point2f> Sequence::getMarkers(unsigned int camera) const {
+	// check camera index
+	if (camera > 1) {
+		throw "there are only two cameras";
+	}
+
+	// return marker positions
+	return markers[camera];
+}
+
+void Sequence::readVideo(VideoCapture &vid, vector<Mat> &data, unsigned int numberOfFrames, const Calibration &calib, unsigned int camera, bool undistortImages, const atomic<bool> &stop) {
+	// resize vector to number of frames
+	data.clear();
+	data.resize(numberOfFrames);
+
+	// load images from video until its end or until the decoding of the other video failed
+	for (unsigned int i = 0; i < numberOfFrames; ++i) {
+		if (stop || !readFrame(vid, data[i], calib, camera, undistortImages)) {
+			// drop missing frames, the lengths of both videos are compared afterwards
+			data.resize(i);
+			break;
+		}
+	}
+}
+
+bool Sequence::readFrame(VideoCapture &vid, Mat &image, const Calibration &calib, unsigned int camera, bool undistortImage) {
+	Mat img, gray;
+
+	// load next frame
+	{
+		PROFILE_SCOPE("decode");
+		if (!vid.read(img) || img.empty()) {
+			return false;
+		}
+	}
+
+	// convert frame to grayscale directly into the given image if it is not undistorted
+	if (!undistortImage) {
+		PROFILE_SCOPE("convert");
+		cvtColor(img, image, COLOR_BGR2GRAY);
+		return true;
+	}
+	{
+		PROFILE_SCOPE("convert");
+		cvtColor(img, gray, COLOR_BGR2GRAY);
+	}
+
+	// undistort the image into the given image with the cached remap tables
+	calib.undistortImage(camera, gray, image);
+
+	return true;
+}
+
+bool Sequence::readFramePair(unsigned int slot) {
+	// decode the frame of the second video on a separate thread
+	auto decoder = async(launch::async, [&]() { return readFrame(videos[1], images[1][slot], calib, 1, undistortImages); });
+	bool read1;
+	try {
+		read1 = readFrame(videos[0], images[0][slot], calib, 0, undistortImages);
+	} catch (...) {
+		decoder.wait();
+		throw;
+	}
+	const bool read2 = decoder.get();
+
+	// both videos must end at the same frame
+	if (read1 != read2) {
+		throw "both videos have different number of frames";
+	}
+	return read1;
+}
+
+unsigned int Sequence::openVideo(const string &file, VideoCapture &vid) {
+	// open video file
+	if (!vid.open(file)) {
+		throw "could not open video file " + file;
+	}
+
+	// get number of frames from the video file
+	return static_cast<unsigned int>(vid.get(CAP_PROP_FRAME_COUNT));
+}
+
+void Sequence::loadMarkers(const string &folder) {
+	// load marker positions for both videos
+	readMarkers(folder + Constants::markers1File, 0);
+	readMarkers(folder + Constants::markers2File, 1);
+
+	// check if both videos have the same amount of markers
+	if (markers[0].size() != markers[1].size()) {
+		throw "both videos have different number of markers";
+	}
+
+	// sort the markers so that they have the same ordering for both videos
+	sortMarkers();
+}
+
+void Sequence::readMarkers(const string &file, unsigned int camera) {
+	// read raw data from file
+	Mat markerData = readMatrix(file);
+
+	// check matrix dimension for validity
+	checkMatrixDimensions(markerData, -1, 2, "marker positions");
+
+	// resize vector to take marker positions
+	vector<Point2f> &data = markers[camera];
+	data.clear();
+	data.resize(markerData.rows);
+
+	// save marker positions in the vector
+	for (int i = 0; i < markerData.rows; ++i) {
+		data[i].x = markerData.at<float>(i, 0);
+		data[i].y = markerData.at<float>(i, 1);
+	}
+
+	// transfer the marker positions into the distorted image if the images are not undistorted
+	if (!undistortImages) {
+		calib.distortPoints(camera, data, data);
+	}
+
+	// and refine the marker positions
+	cornerSubPix(getFrame(camera, 0), data, Constants::markerRefinementWindowSize, Constants::markerRefinementZeroZone, Constants::markerRefinementCriteria);
+}
+
+
+void Sequence::sortMarkers() {
+	//sort both vectors so that the positions are corresponding
+
+	// the order of fewer than two markers is always correct
+	if (markers[0].size() < 2) {
+		return;
+	}
+
+	// the epipolar constraint only holds for undistorted positions
+	vector<Point2f> undistortedMarkers[2] = { markers[0], markers[1] };
+	if (!undistortImages) {
+		calib.undistortPoints(0, markers[0], undistortedMarkers[0]);
+		calib.undistortPoints(1, markers[1], undistortedMarkers[1]);
+	}
+
+	float sourceMarker_X = undistortedMarkers[0][0].x;
+	float sourceMarker_Y = undistortedMarkers[0][0].y;
+	float targetMarker_X = undistortedMarkers[1][0].x;
+	float targetMarker_Y = undistortedMarkers[1][0].y;
+	float sectargetMarker_X = undistortedMarkers[1][1].x;
+	float sectargetMarker_Y = undistortedMarkers[1][1].y;
+	
+	const Vec3d sourceMarker(sourceMarker_X, sourceMarker_Y, 1);
+	const Vec3d targetMarker(targetMarker_X, targetMarker_Y, 1);
+	const Vec3d sectargetMarker(sectargetMarker_X, sectargetMarker_Y, 1);
+
+	//std::vector<cv::Point2f> newmarkers[2];
+	//Mat newsourceMarker = (Mat_<cv::Point_<float>>(1, 2) << newmarkers[1][0], newmarkers[1][1]);
+	//Mat newtargetMarker = (Mat_<cv::Point_<float>>(1, 2) << newmarkers[1][0], newmarkers[1][1]);
+
+	//fundamental matrix
+	const Matx33d &fundMat = calib.getFundamentalMatx();
+	//Mat firstEpipolar = (sourceMarker*fundMat)*targetMarker;
+	//Mat secondEpipolar = (sourceMarker*fundMat)*sectargetMarker;
+	
+	//calculate epipolar of two camera
+	const double firstEpipolar = targetMarker.dot(fundMat * sourceMarker);
+	const double secondEpipolar = sectargetMarker.dot(fundMat * sourceMarker);
+	//float* firEpiVal = (float*)firstEpipolar.data;
+	bool isFirpointclose2zero = abs(firstEpipolar) < abs(secondEpipolar);
+	//bool isFirpointclose2zero = abs(firstEpipolar) < abs(*(float*)secondEpipolar.data);
+
+	if (!isFirpointclose2zero){
+		std::vector<cv::Point2f> newmarkers[1];
+		newmarkers[0] = markers[1];
+		markers[1][0] = markers[1][1];
+		markers[1][1] = newmarkers[0][0];
+	}
+}
@@ -1,100 +1,259 @@
-#pragma once
-
-#include <string>
-#include <vector>
-#include <opencv2/opencv.hpp>
-
-#include "Calibration.hpp"
-
-namespace CVLab {
-	/**
-	 * Class for loading and encapsulating sequence data.
-	 * A sequence consists of the images for both cameras and the positions for all markers in the first image in both cameras.
-	 * The images can be retrieved from an instance of this class in an array notation obj[camera][image]. The index for camera and image are 0-based.
-	 * The marker positions can be retrieved by the method getMarkers which expects the 0-based camera index.
-	 */
-	class Sequence {
-	public:
-		/**
-		 * Create an object and load the data.
-		 *
-		 * \param[in] folder The folder to load the sequence data from.
-		 * \param[in] c Calibration data.
-		 */
-		Sequence(const std::string &folder, const Calibration &c);
-
-		/**
-		 * Copy Constructor. Creates an object by copying the data from another object. A deep copy of the data is created.
-		 *
-		 * \param[in] other The object to copy the data from.
-		 */
-		Sequence(const Sequence &other);
-
-		/**
-		 * Get the number of frames in the sequence.
-		 */
-		unsigned int getNumberOfFrames() const;
-
-		/**
-		 * Get the images for the given camera.
-		 *
-		 * \param[in] camera Index of the camera to get the images for.
-		 */
-		const std::vector<cv::Mat> & operator[](unsigned int camera) const;
-
-		/**
-		 * Get the marker positions in the first frame.
-		 *
-		 * \param[in] camera Index of the camera to get the marker positions for.
-		 */
-		std::vector<cv::Point2f> getMarkers(unsigned int camera) const;
-
-	private:
-		/**
-		 * Assignment operator. It is disabled as it is not possible to assign constant values.
-		 *
-		 * \param[in] other The other object that should be assigned to this one.
-		 */
-		Sequence & operator=(const Sequence &other);
-
-		/**
-		 * Read a video from file and save the images in memory.
-		 * The images will be converted to grayscale und undistorted.
-		 *
-		 * \param[in] file The file to read the video from.
-		 * \param[out] data The images of the video.
-		 * \param[in] K Intrinsics of the camera that recorded the video.
-		 * \param[in] distortion Distortion coefficients of the camera that recorded the video.
-		 */
-		static void readVideo(const std::string &file, std::vector<cv::Mat> &data, const cv::Mat &K, const cv::Mat &distortion);
-
-		/**
-		 * Read the marker positions for a camera from a file.
-		 *
-		 * \param[in] file The file to read the marker positions from.
-		 * \param[out] data The marker positions.
-		 * \param[in] firstImage The first image of the corresponding video to refine the marker position.
-		 */
-		static void readMarkers(const std::string &file, std::vector<cv::Point2f> &data, const cv::Mat &firstImage);
-
-		/**
-		 * Sort the markers data structure so that the array positions correspond to each other.
-		 */
-		void sortMarkers();
-
-		/**
-		 * Calibration data.
-		 */
-		const Calibration &calib;
-
-		/**
-		 * Undistorted and converted images of the videos.
-		 */
-		std::vector<cv::Mat> images[2];
-
-		/**
-		 * Marker positions of the first frames in the videos.
-		 */
-		std::vector<cv::Point2f> markers[2];
-	};
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+#include "Calibration.hpp"
+#include "FrameCache.hpp"
+
+namespace CVLab {
+	/**
+	 * Class for loading and encapsulating sequence data.
+	 * A sequence consists of the images for both cameras and the positions for all markers in the first image in both cameras.
+	 * The images can be retrieved from an instance of this class in an array notation obj[camera][image]. The index for camera and image are 0-based.
+	 * The marker positions can be retrieved by the method getMarkers which expects the 0-based camera index.
+	 *
+	 * In streaming mode the videos are not loaded completely. Instead, the frames are decoded on demand by readNextFrame
+	 * into a ring of a fixed number of frames per camera, so the memory consumption does not depend on the length of the sequence.
+	 * The frames inside of this window can be retrieved by getFrame.
+	 */
+	class Sequence {
+	public:
+		/**
+		 * Create an object and load the data. If a window is given, the sequence is opened in streaming mode and only the first frame is loaded,
+		 * all following frames are decoded by readNextFrame.
+		 *
+		 * If the images are not undistorted, the sequence consists of the distorted grayscale images and the marker positions are given in the
+		 * distorted images as well. The tracked positions then have to be undistorted with Calibration::undistortPoints. This is much cheaper
+		 * than undistorting the whole images as only a few marker positions are needed per frame.
+		 *
+		 * If a cache file is given, the preprocessed images are loaded from it if it has been created from the same calibration data and videos.
+		 * Otherwise, the images are decoded from the videos and written to the cache file once all frames have been decoded.
+		 *
+		 * \param[in] folder The folder to load the sequence data from.
+		 * \param[in] c Calibration data.
+		 * \param[in] window Number of frames per camera that are kept in memory in streaming mode. It has to be 0 for loading the whole sequence or at least 2.
+		 * \param[in] undistortImages Flag indicating whether the images should be undistorted.
+		 * \param[in] cacheFile The file for caching the preprocessed images or an empty string for not using a cache.
+		 */
+		Sequence(const std::string &folder, const Calibration &c, unsigned int window = 0, bool undistortImages = true, const std::string &cacheFile = std::string());
+
+		/**
+		 * Copy Constructor. Creates an object by copying the data from another object. A deep copy of the data is created.
+		 * A sequence in streaming mode cannot be copied.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		Sequence(const Sequence &other);
+
+		/**
+		 * Get the number of frames in the sequence.
+		 */
+		unsigned int getNumberOfFrames() const;
+
+		/**
+		 * Check whether the sequence is in streaming mode.
+		 */
+		bool isStreaming() const;
+
+		/**
+		 * Check whether the images and marker positions of the sequence are undistorted.
+		 */
+		bool hasUndistortedImages() const;
+
+		/**
+		 * Decode the next frame of both videos into the window. This is only possible in streaming mode.
+		 * The oldest frame in the window is overwritten.
+		 *
+		 * \returns False if there are no more frames in the sequence, otherwise true.
+		 */
+		bool readNextFrame();
+
+		/**
+		 * Detach the decoding of the following frames from the sequence, so they can be decoded elsewhere, e.g. in the stages of a pipeline.
+		 * This is only possible in streaming mode at the first frame if the images are not loaded from a cache. Afterwards the sequence
+		 * cannot be advanced with readNextFrame any more, the frames are decoded with decodeFrame instead.
+		 *
+		 * \returns The writer of the cache file, which already contains the first frame, or an empty pointer if no cache file is written.
+		 */
+		std::unique_ptr<FrameCache::Writer> detachDecoding();
+
+		/**
+		 * Decode the next frame of a video after the decoding has been detached. The image is converted to grayscale, but not undistorted.
+		 * The videos of both cameras can be decoded concurrently.
+		 *
+		 * \param[in] camera Index of the camera to decode the frame for.
+		 * \param[out] image The grayscale image.
+		 * \returns False if there is no more frame in the video, otherwise true.
+		 */
+		bool decodeFrame(unsigned int camera, cv::Mat &image);
+
+		/**
+		 * Get the cache the images are loaded from.
+		 *
+		 * \returns The cache or an empty pointer if the images are decoded from the videos.
+		 */
+		std::shared_ptr<FrameCache> getCache() const;
+
+		/**
+		 * Get the index of the last frame that has been loaded.
+		 */
+		unsigned int getCurrentFrame() const;
+
+		/**
+		 * Get a single image of the sequence. In streaming mode only the frames inside of the window are available.
+		 *
+		 * \param[in] camera Index of the camera to get the image for.
+		 * \param[in] frame Index of the frame.
+		 */
+		const cv::Mat & getFrame(unsigned int camera, unsigned int frame) const;
+
+		/**
+		 * Get the images for the given camera. This is not possible in streaming mode.
+		 *
+		 * \param[in] camera Index of the camera to get the images for.
+		 */
+		const std::vector<cv::Mat> & operator[](unsigned int camera) const;
+
+		/**
+		 * Get the marker positions in the first frame. They are given in the distorted image if the images are not undistorted.
+		 *
+		 * \param[in] camera Index of the camera to get the marker positions for.
+		 */
+		std::vector<cv::Point2f> getMarkers(unsigned int camera) const;
+
+	private:
+		/**
+		 * Assignment operator. It is disabled as it is not possible to assign constant values.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		Sequence & operator=(const Sequence &other);
+
+		/**
+		 * Read all frames of an opened video and save the images in memory.
+		 * The images will be converted to grayscale und undistorted.
+		 * If the video ends before the expected number of frames, only the decoded frames are kept. The decoding is stopped
+		 * early as soon as the stop flag is set because the decoding of the other video failed.
+		 *
+		 * \param[in,out] vid The opened video to read the frames from.
+		 * \param[out] data The images of the video.
+		 * \param[in] numberOfFrames Expected number of frames in the video.
+		 * \param[in] calib Calibration data for undistorting the images.
+		 * \param[in] camera Index of the camera that recorded the video.
+		 * \param[in] undistortImages Flag indicating whether the images should be undistorted.
+		 * \param[in] stop Flag set when the decoding of the other video failed.
+		 */
+		static void readVideo(cv::VideoCapture &vid, std::vector<cv::Mat> &data, unsigned int numberOfFrames, const Calibration &calib, unsigned int camera, bool undistortImages, const std::atomic<bool> &stop);
+
+		/**
+		 * Read the next frame of an opened video. The image will be converted to grayscale and undistorted if requested.
+		 * The memory of the given image is reused if it has the correct size and type.
+		 *
+		 * \param[in,out] vid The opened video to read the frame from.
+		 * \param[out] image The converted and undistorted image.
+		 * \param[in] calib Calibration data for undistorting the image.
+		 * \param[in] camera Index of the camera that recorded the video.
+		 * \param[in] undistortImage Flag indicating whether the image should be undistorted.
+		 * \returns False if there is no more frame in the video, otherwise true.
+		 */
+		static bool readFrame(cv::VideoCapture &vid, cv::Mat &image, const Calibration &calib, unsigned int camera, bool undistortImage);
+
+		/**
+		 * Read the next frame of both videos concurrently into the given position of the ring.
+		 *
+		 * \param[in] slot Position in the ring to store the images.
+		 * \returns False if there is no more frame in the videos, otherwise true.
+		 */
+		bool readFramePair(unsigned int slot);
+
+		/**
+		 * Open a video file for reading.
+		 *
+		 * \param[in] file The file to read the video from.
+		 * \param[out] vid The opened video.
+		 * \returns The number of frames in the video.
+		 */
+		static unsigned int openVideo(const std::string &file, cv::VideoCapture &vid);
+
+		/**
+		 * Load the marker positions for both cameras from the folder and sort them.
+		 *
+		 * \param[in] folder The folder to load the marker positions from.
+		 */
+		void loadMarkers(const std::string &folder);
+
+		/**
+		 * Read the marker positions for a camera from a file.
+		 * The positions in the file are given in the undistorted image. They are distorted if the images are not undistorted.
+		 *
+		 * \param[in] file The file to read the marker positions from.
+		 * \param[in] camera Index of the camera the marker positions belong to.
+		 */
+		void readMarkers(const std::string &file, unsigned int camera);
+
+		/**
+		 * Sort the markers data structure so that the array positions correspond to each other.
+		 */
+		void sortMarkers();
+
+		/**
+		 * Calibration data.
+		 */
+		const Calibration &calib;
+
+		/**
+		 * Undistorted and converted images of the videos. In streaming mode this is the ring of the frames inside of the window,
+		 * frame i is stored at position i % window.
+		 */
+		std::vector<cv::Mat> images[2];
+
+		/**
+		 * Opened videos for decoding the frames. They are released after loading when not in streaming mode.
+		 */
+		cv::VideoCapture videos[2];
+
+		/**
+		 * Number of frames in the sequence.
+		 */
+		unsigned int numberOfFrames;
+
+		/**
+		 * Index of the last loaded frame.
+		 */
+		unsigned int currentFrame;
+
+		/**
+		 * Number of frames kept in memory in streaming mode or 0 if the sequence is loaded completely.
+		 */
+		unsigned int window;
+
+		/**
+		 * Flag indicating whether the images are undistorted.
+		 */
+		bool undistortImages;
+
+		/**
+		 * Flag indicating whether the decoding of the following frames has been detached from the sequence.
+		 */
+		bool decodingDetached;
+
+		/**
+		 * Cache the images are loaded from. The images reference the memory of the cache.
+		 */
+		std::shared_ptr<FrameCache> cache;
+
+		/**
+		 * Writer for the cache file while the images of a sequence in streaming mode are decoded.
+		 */
+		std::unique_ptr<FrameCache::Writer> cacheWriter;
+
+		/**
+		 * Marker positions of the first frames in the videos.
+		 */
+		std::vector<cv::Point2f> markers[2];
+	};
 }
\ No newline at end of file
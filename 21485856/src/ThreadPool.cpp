@@ -0,0 +1,146 @@
+#include "ThreadPool.hpp"
+
+#include "Profiler.hpp"
+
+using namespace CVLab;
+using namespace std;
+
+namespace {
+	/**
+	 * The pool the current thread belongs to, if any.
+	 */
+	thread_local const ThreadPool *currentPool = nullptr;
+
+	/**
+	 * Index of the current thread in its pool.
+	 */
+	thread_local unsigned int currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int numberOfThreads) : queuedTasks(0), pendingTasks(0), nextWorker(0), stopping(false) {
+	// use all hardware threads by default
+	if (numberOfThreads == 0) {
+		numberOfThreads = max(thread::hardware_concurrency(), 1u);
+	}
+
+	// create the queues before starting any thread, as the threads steal from all queues
+	for (unsigned int i = 0; i < numberOfThreads; ++i) {
+		workers.emplace_back(new Worker());
+	}
+	for (unsigned int i = 0; i < numberOfThreads; ++i) {
+		threads.emplace_back(&ThreadPool::run, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	// let all tasks finish, errors are ignored
+	{
+		unique_lock<mutex> lock(stateMutex);
+		tasksDone.wait(lock, [this]() { return pendingTasks == 0; });
+		stopping = true;
+	}
+
+	// and stop the threads
+	taskAvailable.notify_all();
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+void ThreadPool::submit(function<void()> task) {
+	++pendingTasks;
+
+	// keep tasks of a task on the same thread, distribute the other tasks
+	const unsigned int index = (currentPool == this) ? currentWorker : (nextWorker++ % workers.size());
+
+	// count the task before queueing it, so a waiting thread cannot miss it
+	{
+		lock_guard<mutex> lock(stateMutex);
+		++queuedTasks;
+	}
+	PROFILE_COUNTER("queued tasks", queuedTasks.load());
+	{
+		lock_guard<mutex> lock(workers[index]->mutex);
+		workers[index]->tasks.push_back(move(task));
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+	unique_lock<mutex> lock(stateMutex);
+	tasksDone.wait(lock, [this]() { return pendingTasks == 0; });
+
+	// report the first exception of a task
+	if (error) {
+		exception_ptr err = error;
+		error = nullptr;
+		rethrow_exception(err);
+	}
+}
+
+unsigned int ThreadPool::getNumberOfThreads() const {
+	return static_cast<unsigned int>(threads.size());
+}
+
+void ThreadPool::run(unsigned int index) {
+	currentPool = this;
+	currentWorker = index;
+	PROFILE_THREAD("worker " + to_string(index + 1));
+
+	function<void()> task;
+	for (;;) {
+		// execute the next task and keep its exception
+		if (takeTask(index, task)) {
+			try {
+				task();
+			} catch (...) {
+				lock_guard<mutex> lock(stateMutex);
+				if (!error) {
+					error = current_exception();
+				}
+			}
+			task = nullptr;
+
+			// wake up the threads waiting for the completion of all tasks
+			if (--pendingTasks == 0) {
+				lock_guard<mutex> lock(stateMutex);
+				tasksDone.notify_all();
+			}
+			continue;
+		}
+
+		// wait for new tasks if all queues are empty
+		unique_lock<mutex> lock(stateMutex);
+		taskAvailable.wait(lock, [this]() { return (queuedTasks > 0) || stopping; });
+		if (stopping && (queuedTasks == 0)) {
+			return;
+		}
+	}
+}
+
+bool ThreadPool::takeTask(unsigned int index, function<void()> &task) {
+	// take the newest task of the own queue
+	{
+		Worker &own = *workers[index];
+		lock_guard<mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = move(own.tasks.back());
+			own.tasks.pop_back();
+			--queuedTasks;
+			return true;
+		}
+	}
+
+	// or steal the oldest task of another queue
+	for (size_t i = 1; i < workers.size(); ++i) {
+		Worker &other = *workers[(index + i) % workers.size()];
+		lock_guard<mutex> lock(other.mutex);
+		if (!other.tasks.empty()) {
+			task = move(other.tasks.front());
+			other.tasks.pop_front();
+			--queuedTasks;
+			return true;
+		}
+	}
+	return false;
+}
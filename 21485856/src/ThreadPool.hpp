@@ -0,0 +1,150 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+namespace CVLab {
+	/**
+	 * Pool of threads executing tasks with work stealing. Each thread has its own queue of tasks. Tasks submitted
+	 * by a task are put into the queue of the thread executing it and are taken from there in last-in first-out
+	 * order, so a thread finishes the work it has started first. Threads without work steal the oldest tasks from
+	 * the queues of the other threads. Tasks submitted from outside the pool are distributed over all queues.
+	 */
+	class ThreadPool {
+	public:
+		/**
+		 * Constructor. Starts the threads.
+		 *
+		 * \param[in] numberOfThreads Number of threads. If it is zero, one thread per hardware thread is started.
+		 */
+		explicit ThreadPool(unsigned int numberOfThreads = 0);
+
+		/**
+		 * Destructor. Waits until all submitted tasks have been executed and stops the threads.
+		 */
+		~ThreadPool();
+
+		/**
+		 * Submit a task for execution. It can also be called from a task.
+		 *
+		 * \param[in] task The task to execute.
+		 */
+		void submit(std::function<void()> task);
+
+		/**
+		 * Wait until all submitted tasks, including the tasks submitted by them, have been executed. It must not be called
+		 * from a task. If a task threw an exception, the first one is rethrown.
+		 */
+		void wait();
+
+		/**
+		 * Get the number of threads.
+		 *
+		 * \returns The number of threads.
+		 */
+		unsigned int getNumberOfThreads() const;
+
+	private:
+		/**
+		 * Queue of tasks of a thread.
+		 */
+		struct Worker {
+			/**
+			 * The tasks, new tasks are appended at the back.
+			 */
+			std::deque<std::function<void()>> tasks;
+
+			/**
+			 * Mutex for the tasks.
+			 */
+			std::mutex mutex;
+		};
+
+		/**
+		 * Copy constructor. It is disabled as the threads cannot be shared.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		ThreadPool(const ThreadPool &other);
+
+		/**
+		 * Assignment operator. It is disabled as the threads cannot be shared.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		ThreadPool & operator=(const ThreadPool &other);
+
+		/**
+		 * Main loop of a thread.
+		 *
+		 * \param[in] index Index of the thread.
+		 */
+		void run(unsigned int index);
+
+		/**
+		 * Take the newest task of the own queue or steal the oldest task of another queue.
+		 *
+		 * \param[in] index Index of the thread.
+		 * \param[out] task The task to execute.
+		 * \returns True if a task has been found.
+		 */
+		bool takeTask(unsigned int index, std::function<void()> &task);
+
+		/**
+		 * The queues of all threads.
+		 */
+		std::vector<std::unique_ptr<Worker>> workers;
+
+		/**
+		 * The threads.
+		 */
+		std::vector<std::thread> threads;
+
+		/**
+		 * Number of tasks in the queues.
+		 */
+		std::atomic<size_t> queuedTasks;
+
+		/**
+		 * Number of tasks that have been submitted but not been executed completely.
+		 */
+		std::atomic<size_t> pendingTasks;
+
+		/**
+		 * Queue for the next task submitted from outside the pool.
+		 */
+		std::atomic<unsigned int> nextWorker;
+
+		/**
+		 * Flag indicating that the threads should stop.
+		 */
+		bool stopping;
+
+		/**
+		 * Mutex for waiting for tasks, for the completion of all tasks and for the first exception.
+		 */
+		std::mutex stateMutex;
+
+		/**
+		 * Condition for waiting for new tasks.
+		 */
+		std::condition_variable taskAvailable;
+
+		/**
+		 * Condition for waiting for the completion of all tasks.
+		 */
+		std::condition_variable tasksDone;
+
+		/**
+		 * The first exception thrown by a task.
+		 */
+		std::exception_ptr error;
+	};
+}
\ No newline at end of file
@@ -1,46 +1,304 @@
-#include "Tracking.hpp"
-#include "tools.hpp"
-//#include "Sequence.hpp"
-
-using namespace CVLab;
-using namespace cv;
-using namespace std;
-
-Tracking::Tracking(const Calibration &c) : calib(c){
-	cerr << "construction called" << endl;	
-}
-
-Tracking::Tracking(const Tracking &other) : calib(other.calib){
-
-}
-
-
-vector<vector<Point2f>> Tracking::operator()(const vector<Mat> &images, const vector<Point2f> &initMarkers) const {
-	//tracking the marker position in one video
-	
-	//throw "Tracking::operator() is not implemented";
-	cerr << "operator called" << endl;
-	vector<Point2f> prevMarker;
-	vector<Point2f> nextMarker;
-	vector<uchar> status;
-	vector<float> error;
-	vector<vector<Point2f>> trackedMarkers;
-
-	int numFrame = images.size();
-	trackedMarkers.resize(numFrame, vector<Point2f>(2));
-	//record the first position
-	trackedMarkers[0] = initMarkers;
-	prevMarker = initMarkers;
-	//goodFeaturesToTrack(images[0], initMarkers, 30, 0.01, 30);
-	for (int i = 0; i < numFrame-1; i++)
-	{
-		//Calculates an optical flow for a sparse feature set using the iterative Lucas-Kanade method with pyramids.
-		//http://docs.opencv.org/2.4/modules/video/doc/motion_analysis_and_object_tracking.html
-		calcOpticalFlowPyrLK(images[i], images[i + 1], prevMarker, nextMarker, status, error, Size(11, 11), 5);
-		//trackedMarkers[i] = nextMarker;
-		prevMarker = nextMarker;
-		trackedMarkers[i+1] = nextMarker;
-	}
-	cerr << "operator runned" << endl;
-	return trackedMarkers;
-}
+#include "Tracking.hpp"
+
+#include <future>
+#include <thread>
+#include <algorithm>
+
+#include "tools.hpp"
+#include "Constants.hpp"
+#include "Profiler.hpp"
+//#include "Sequence.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+Tracking::Tracking(const Calibration &c, bool regionTracking, unsigned int chunks) : calib(c), regionTracking(regionTracking), chunks(chunks){
+}
+
+Tracking::Tracking(const Tracking &other) : calib(other.calib), regionTracking(other.regionTracking), chunks(other.chunks){
+
+}
+
+
+TrackBuffer Tracking::operator()(const vector<Mat> &images, const vector<Point2f> &initMarkers) const {
+	//tracking the marker position in one video
+	return (chunks > 1) ? trackChunks(images, initMarkers) : trackFrames(images, 0, images.size(), initMarkers);
+}
+
+void Tracking::trackStereo(const Sequence &sequence, TrackBuffer trackedMarkers[2]) const {
+	// track the second camera on a separate thread
+	auto tracker = async(launch::async, [&]() { trackedMarkers[1] = (*this)(sequence[1], sequence.getMarkers(1)); });
+	try {
+		trackedMarkers[0] = (*this)(sequence[0], sequence.getMarkers(0));
+	} catch (...) {
+		tracker.wait();
+		throw;
+	}
+	tracker.get();
+}
+
+vector<Point2f> Tracking::operator()(const Mat &prevImage, const Mat &nextImage, const vector<Point2f> &prevMarkers) const {
+	if (regionTracking) {
+		return trackRegions(prevImage, nextImage, prevMarkers);
+	}
+
+	vector<Mat> prevPyramid;
+	vector<Mat> nextPyramid;
+	buildPyramid(prevImage, prevPyramid);
+	buildPyramid(nextImage, nextPyramid);
+	return track(prevPyramid, nextPyramid, prevMarkers);
+}
+
+vector<Point2f> Tracking::track(const vector<Mat> &prevPyramid, const vector<Mat> &nextPyramid, const vector<Point2f> &prevMarkers) const {
+	vector<Point2f> nextMarkers;
+	vector<uchar> status;
+	vector<float> error;
+
+	//Calculates an optical flow for a sparse feature set using the iterative Lucas-Kanade method with pyramids.
+	//http://docs.opencv.org/2.4/modules/video/doc/motion_analysis_and_object_tracking.html
+	PROFILE_SCOPE("lucas-kanade");
+	calcOpticalFlowPyrLK(prevPyramid, nextPyramid, prevMarkers, nextMarkers, status, error, Constants::trackingWindowSize, Constants::trackingPyramidLevels);
+
+	return nextMarkers;
+}
+
+void Tracking::buildPyramid(const Mat &image, vector<Mat> &pyramid) {
+	PROFILE_SCOPE("pyramid");
+	buildOpticalFlowPyramid(image, pyramid, Constants::trackingWindowSize, Constants::trackingPyramidLevels, true);
+}
+
+void Tracking::start(const Mat &image, const vector<Point2f> &markers, State &state) const {
+	state.image = image;
+	state.markers = markers;
+	if (!regionTracking) {
+		buildPyramid(image, state.pyramid);
+	}
+}
+
+const vector<Point2f> & Tracking::step(const Mat &image, State &state) const {
+	if (regionTracking) {
+		state.markers = trackRegions(state.image, image, state.markers);
+	} else {
+		// build the pyramid of the next frame and keep it as the pyramid of the previous frame for the next step
+		buildPyramid(image, state.nextPyramid);
+		state.markers = track(state.pyramid, state.nextPyramid, state.markers);
+		swap(state.pyramid, state.nextPyramid);
+	}
+	state.image = image;
+	return state.markers;
+}
+
+bool Tracking::isRegionTracking() const {
+	return regionTracking;
+}
+
+const vector<Point2f> & Tracking::State::getMarkers() const {
+	return markers;
+}
+
+vector<Point2f> Tracking::trackRegions(const Mat &prevImage, const Mat &nextImage, const vector<Point2f> &prevMarkers) const {
+	// markers that cannot be assigned to a region keep their position
+	vector<Point2f> nextMarkers(prevMarkers);
+
+	// get the regions around the markers
+	vector<Rect> regions;
+	vector<vector<unsigned int>> regionMarkers;
+	getTrackingRegions(prevMarkers, prevImage.size(), regions, regionMarkers);
+
+	// track the markers in each region on the pyramids of the region
+	vector<Mat> prevPyramid, nextPyramid;
+	vector<Point2f> prevRegionMarkers, nextRegionMarkers;
+	vector<uchar> status;
+	vector<float> error;
+	for (unsigned int i = 0; i < regions.size(); ++i) {
+		const Point2f offset(static_cast<float>(regions[i].x), static_cast<float>(regions[i].y));
+
+		// get marker positions relative to the region
+		prevRegionMarkers.clear();
+		for (unsigned int marker : regionMarkers[i]) {
+			prevRegionMarkers.push_back(prevMarkers[marker] - offset);
+		}
+
+		// build pyramids of the region and track the markers
+		buildPyramid(prevImage(regions[i]), prevPyramid);
+		buildPyramid(nextImage(regions[i]), nextPyramid);
+		{
+			PROFILE_SCOPE("lucas-kanade");
+			calcOpticalFlowPyrLK(prevPyramid, nextPyramid, prevRegionMarkers, nextRegionMarkers, status, error, Constants::trackingWindowSize, Constants::trackingPyramidLevels);
+		}
+
+		// and transfer the positions back into the image
+		for (unsigned int j = 0; j < regionMarkers[i].size(); ++j) {
+			nextMarkers[regionMarkers[i][j]] = nextRegionMarkers[j] + offset;
+		}
+	}
+
+	return nextMarkers;
+}
+
+void Tracking::getTrackingRegions(const vector<Point2f> &markers, const Size &imageSize, vector<Rect> &regions, vector<vector<unsigned int>> &regionMarkers) {
+	const Rect imageRect(Point(0, 0), imageSize);
+	const int padding = Constants::trackingRegionPadding;
+
+	regions.clear();
+	regionMarkers.clear();
+	for (unsigned int marker = 0; marker < markers.size(); ++marker) {
+		// create padded region around the marker and clip it to the image
+		Rect region = Rect(cvFloor(markers[marker].x) - padding, cvFloor(markers[marker].y) - padding, 2 * padding + 1, 2 * padding + 1) & imageRect;
+		if (region.area() == 0) {
+			continue;
+		}
+		vector<unsigned int> members(1, marker);
+
+		// merge all regions overlapping with the new region, the merged region may overlap with further regions
+		for (unsigned int i = 0; i < regions.size(); ) {
+			if ((region & regions[i]).area() > 0) {
+				region |= regions[i];
+				members.insert(members.end(), regionMarkers[i].begin(), regionMarkers[i].end());
+				regions[i] = regions.back();
+				regions.pop_back();
+				regionMarkers[i].swap(regionMarkers.back());
+				regionMarkers.pop_back();
+				i = 0;
+			} else {
+				++i;
+			}
+		}
+
+		regions.push_back(region);
+		regionMarkers.push_back(members);
+	}
+}
+
+TrackBuffer Tracking::trackFrames(const vector<Mat> &images, unsigned int first, unsigned int end, const vector<Point2f> &initMarkers) const {
+	State state;
+
+	int numFrame = end - first;
+	TrackBuffer trackedMarkers(numFrame, initMarkers.size());
+	//goodFeaturesToTrack(images[0], initMarkers, 30, 0.01, 30);
+	//the tracking state builds each pyramid only once and reuses it as the previous pyramid in the next step
+	if (numFrame > 0) {
+		//record the first position
+		trackedMarkers.setFrame(0, initMarkers);
+		start(images[first], initMarkers, state);
+	}
+	for (int i = 0; i < numFrame-1; i++)
+	{
+		trackedMarkers.setFrame(i+1, step(images[first + i + 1], state));
+	}
+	return trackedMarkers;
+}
+
+TrackBuffer Tracking::trackChunks(const vector<Mat> &images, const vector<Point2f> &initMarkers) const {
+	// each chunk needs more frames than the overlap, otherwise track serially
+	const unsigned int numFrames = images.size();
+	const unsigned int numChunks = min(chunks, numFrames / (Constants::trackingChunkOverlap + 1));
+	if (numChunks <= 1) {
+		return trackFrames(images, 0, numFrames, initMarkers);
+	}
+
+	// predict the marker positions at the start of the chunks
+	const TrackBuffer coarseMarkers = trackCoarse(images, initMarkers);
+
+	// get the first frame of each chunk, chunk k covers the frames from starts[k] to starts[k + 1]
+	vector<unsigned int> starts(numChunks + 1);
+	for (unsigned int k = 0; k <= numChunks; ++k) {
+		starts[k] = static_cast<unsigned int>(static_cast<unsigned long long>(k) * numFrames / numChunks);
+	}
+
+	// track all chunks but the first one concurrently starting before their first frame at the refined predicted positions
+	vector<TrackBuffer> chunkMarkers(numChunks);
+	vector<future<void>> trackers;
+	for (unsigned int k = 1; k < numChunks; ++k) {
+		trackers.push_back(async(launch::async, [&, k]() {
+			const unsigned int first = starts[k] - Constants::trackingChunkOverlap;
+			vector<Point2f> startMarkers = coarseMarkers.getFrame(first);
+			cornerSubPix(images[first], startMarkers, Constants::markerRefinementWindowSize, Constants::markerRefinementZeroZone, Constants::markerRefinementCriteria);
+			chunkMarkers[k] = trackFrames(images, first, starts[k + 1], startMarkers);
+		}));
+	}
+
+	// track the first chunk from the initial positions
+	chunkMarkers[0] = trackFrames(images, 0, starts[1], initMarkers);
+	for (auto &tracker : trackers) {
+		tracker.get();
+	}
+
+	// stitch the chunks together
+	const unsigned int numMarkers = initMarkers.size();
+	TrackBuffer trackedMarkers(numFrames, numMarkers);
+	copy(chunkMarkers[0].data(), chunkMarkers[0].data() + static_cast<size_t>(starts[1]) * numMarkers, trackedMarkers.data());
+	for (unsigned int k = 1; k < numChunks; ++k) {
+		// compare the chunk with the previous chunk on the tracked overlapping frames, the first one only holds the start positions
+		bool agrees = true;
+		for (unsigned int i = 1; agrees && (i < Constants::trackingChunkOverlap); ++i) {
+			const Point2f *previous = trackedMarkers[starts[k] - Constants::trackingChunkOverlap + i];
+			const Point2f *markers = chunkMarkers[k][i];
+			for (unsigned int m = 0; agrees && (m < numMarkers); ++m) {
+				agrees = norm(markers[m] - previous[m]) <= Constants::trackingChunkTolerance;
+			}
+		}
+
+		// a chunk which started on the wrong positions is tracked again serially from the end of the previous chunk
+		if (!agrees) {
+			const TrackBuffer retracked = trackFrames(images, starts[k] - 1, starts[k + 1], trackedMarkers.getFrame(starts[k] - 1));
+			copy(retracked[1], retracked[1] + static_cast<size_t>(starts[k + 1] - starts[k]) * numMarkers, trackedMarkers[starts[k]]);
+			continue;
+		}
+
+		// otherwise copy the frames of the chunk after the overlap
+		const Point2f *markers = chunkMarkers[k][Constants::trackingChunkOverlap];
+		copy(markers, markers + static_cast<size_t>(starts[k + 1] - starts[k]) * numMarkers, trackedMarkers[starts[k]]);
+	}
+
+	return trackedMarkers;
+}
+
+TrackBuffer Tracking::trackCoarse(const vector<Mat> &images, const vector<Point2f> &initMarkers) const {
+	PROFILE_SCOPE("coarse tracking");
+	const unsigned int numFrames = images.size();
+	const float scale = static_cast<float>(1 << Constants::trackingCoarseLevels);
+	const int levels = max(Constants::trackingPyramidLevels - Constants::trackingCoarseLevels, 0);
+
+	// downscale all images, this is done concurrently in blocks of frames
+	vector<Mat> coarseImages(numFrames);
+	const unsigned int numBlocks = max(min(thread::hardware_concurrency(), numFrames), 1u);
+	vector<future<void>> downscalers;
+	for (unsigned int b = 0; b < numBlocks; ++b) {
+		downscalers.push_back(async(launch::async, [&, b]() {
+			for (unsigned int i = b * numFrames / numBlocks; i < (b + 1) * numFrames / numBlocks; ++i) {
+				pyrDown(images[i], coarseImages[i]);
+				for (int level = 1; level < Constants::trackingCoarseLevels; ++level) {
+					pyrDown(coarseImages[i], coarseImages[i]);
+				}
+			}
+		}));
+	}
+	for (auto &downscaler : downscalers) {
+		downscaler.get();
+	}
+
+	// track the markers on the downscaled images
+	TrackBuffer coarseMarkers(numFrames, initMarkers.size());
+	vector<Point2f> markers(initMarkers);
+	for (auto &marker : markers) {
+		marker *= 1 / scale;
+	}
+	vector<Point2f> nextMarkers;
+	vector<uchar> status;
+	vector<float> error;
+	coarseMarkers.setFrame(0, initMarkers);
+	for (unsigned int i = 1; i < numFrames; ++i) {
+		calcOpticalFlowPyrLK(coarseImages[i - 1], coarseImages[i], markers, nextMarkers, status, error, Constants::trackingWindowSize, levels);
+		markers.swap(nextMarkers);
+
+		// scale the positions back to the original images
+		Point2f *frameMarkers = coarseMarkers[i];
+		for (unsigned int m = 0; m < markers.size(); ++m) {
+			frameMarkers[m] = markers[m] * scale;
+		}
+	}
+
+	return coarseMarkers;
+}
@@ -1,45 +1,212 @@
-#pragma once
-
-#include <opencv2/opencv.hpp>
-#include <vector>
-#include "Calibration.hpp"
-#include "Sequence.hpp"
-
-namespace CVLab {
-	/**
-	 * Functor for executing tracking of markers over a sequence of images.
-	 */
-	class Tracking {
-	public:
-		/**
-		 * Constructor.
-		 *
-		 * \param[in] c Calibration data.
-		 */
-		Tracking(const Calibration &c);
-
-		/**
-		 * Copy Constructor. Creates an object by copying the data from another object.
-		 *
-		 * \param[in] other The object to copy the data from.
-		 */
-		Tracking(const Tracking &other);
-
-		/**
-		 * Execute the tracking of the markers on the sequence.
-		 *
-		 * \param[in] images The images of the sequence to track the markers.
-		 * \param[in] initMarkers Positions of the markers in the first frame.
-		 * \returns Vector of vector of marker positions. The outer vector has an entry for each frame whereas the inner vector has an entry for each marker in this frame.
-		 */
-		std::vector<std::vector<cv::Point2f>> operator()(const std::vector<cv::Mat> &images, const std::vector<cv::Point2f> &initMarkers) const;
-
-	private:
-		
-
-		/**
-		 * Calibration data.
-		 */
-		const Calibration &calib;		
-	};
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "Calibration.hpp"
+#include "Sequence.hpp"
+#include "MarkerBuffer.hpp"
+
+namespace CVLab {
+	/**
+	 * Functor for executing tracking of markers over a sequence of images.
+	 *
+	 * In region tracking mode the image pyramids are not built for the whole images but only for padded regions around the markers.
+	 * Overlapping regions are merged. This reduces the costs of tracking a few markers on large images considerably,
+	 * but markers can only be tracked over the displacement covered by Constants::trackingRegionPadding.
+	 *
+	 * In chunked tracking mode a sequence is split into chunks which are tracked concurrently. Each chunk starts Constants::trackingChunkOverlap
+	 * frames before its first frame at the positions predicted by a fast tracking pass on downscaled images. Each chunk is compared with
+	 * the previous chunk on the overlapping frames and tracked again serially from the end of the previous chunk if they disagree.
+	 */
+	class Tracking {
+	public:
+		/**
+		 * State for tracking the markers frame by frame, e.g. on a sequence in streaming mode.
+		 * It is initialized by Tracking::start and advanced by Tracking::step.
+		 */
+		class State {
+		public:
+			/**
+			 * Get the positions of the markers in the last frame.
+			 */
+			const std::vector<cv::Point2f> & getMarkers() const;
+
+		private:
+			friend class Tracking;
+
+			/**
+			 * Image of the last frame.
+			 */
+			cv::Mat image;
+
+			/**
+			 * Pyramid of the image of the last frame. It is not used in region tracking mode.
+			 */
+			std::vector<cv::Mat> pyramid;
+
+			/**
+			 * Buffer for the pyramid of the next frame, so its memory can be reused.
+			 */
+			std::vector<cv::Mat> nextPyramid;
+
+			/**
+			 * Positions of the markers in the last frame.
+			 */
+			std::vector<cv::Point2f> markers;
+		};
+
+		/**
+		 * Constructor.
+		 *
+		 * \param[in] c Calibration data.
+		 * \param[in] regionTracking Flag indicating whether the image pyramids are only built for regions around the markers.
+		 * \param[in] chunks Number of chunks a sequence is split into for tracking the chunks concurrently. The sequence is tracked serially for 1.
+		 */
+		Tracking(const Calibration &c, bool regionTracking = false, unsigned int chunks = 1);
+
+		/**
+		 * Copy Constructor. Creates an object by copying the data from another object.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		Tracking(const Tracking &other);
+
+		/**
+		 * Execute the tracking of the markers on the sequence.
+		 *
+		 * \param[in] images The images of the sequence to track the markers.
+		 * \param[in] initMarkers Positions of the markers in the first frame.
+		 * \returns Buffer with the marker positions for each frame.
+		 */
+		TrackBuffer operator()(const std::vector<cv::Mat> &images, const std::vector<cv::Point2f> &initMarkers) const;
+
+		/**
+		 * Execute the tracking of the markers on both cameras of a completely loaded sequence.
+		 * The cameras are tracked concurrently, the result is the same as tracking each camera for itself.
+		 *
+		 * \param[in] sequence The sequence to track the markers in.
+		 * \param[out] trackedMarkers The tracked marker positions for both cameras in the same format as returned by the tracking of a single camera.
+		 */
+		void trackStereo(const Sequence &sequence, TrackBuffer trackedMarkers[2]) const;
+
+		/**
+		 * Execute the tracking of the markers from one frame to the next one. This is used for consuming the frames of a sequence in streaming mode.
+		 *
+		 * \param[in] prevImage The image of the previous frame.
+		 * \param[in] nextImage The image of the next frame.
+		 * \param[in] prevMarkers Positions of the markers in the previous frame.
+		 * \returns Vector of marker positions in the next frame.
+		 */
+		std::vector<cv::Point2f> operator()(const cv::Mat &prevImage, const cv::Mat &nextImage, const std::vector<cv::Point2f> &prevMarkers) const;
+
+		/**
+		 * Execute the tracking of the markers from one frame to the next one on prebuilt image pyramids.
+		 * As the pyramid of the next frame is the pyramid of the previous frame in the following step, each pyramid only has to be built once.
+		 *
+		 * \param[in] prevPyramid The pyramid of the previous frame built by buildPyramid.
+		 * \param[in] nextPyramid The pyramid of the next frame built by buildPyramid.
+		 * \param[in] prevMarkers Positions of the markers in the previous frame.
+		 * \returns Vector of marker positions in the next frame.
+		 */
+		std::vector<cv::Point2f> track(const std::vector<cv::Mat> &prevPyramid, const std::vector<cv::Mat> &nextPyramid, const std::vector<cv::Point2f> &prevMarkers) const;
+
+		/**
+		 * Build the image pyramid including the gradients of an image as it is needed for tracking.
+		 * The memory of the given pyramid is reused if it has been built for an image of the same size before.
+		 *
+		 * \param[in] image The image to build the pyramid for.
+		 * \param[out] pyramid The image pyramid.
+		 */
+		static void buildPyramid(const cv::Mat &image, std::vector<cv::Mat> &pyramid);
+
+		/**
+		 * Start tracking the markers frame by frame.
+		 *
+		 * \param[in] image The image of the first frame.
+		 * \param[in] markers Positions of the markers in the first frame.
+		 * \param[out] state The tracking state to be initialized.
+		 */
+		void start(const cv::Mat &image, const std::vector<cv::Point2f> &markers, State &state) const;
+
+		/**
+		 * Track the markers into the next frame. The image of the last frame has to be still valid.
+		 *
+		 * \param[in] image The image of the next frame.
+		 * \param[in,out] state The tracking state.
+		 * \returns Positions of the markers in the next frame.
+		 */
+		const std::vector<cv::Point2f> & step(const cv::Mat &image, State &state) const;
+
+		/**
+		 * Check whether the image pyramids are only built for regions around the markers.
+		 */
+		bool isRegionTracking() const;
+
+	private:
+		/**
+		 * Execute the tracking of the markers on a part of a sequence serially.
+		 *
+		 * \param[in] images The images of the sequence.
+		 * \param[in] first Index of the first frame to track the markers in.
+		 * \param[in] end Index after the last frame to track the markers in.
+		 * \param[in] initMarkers Positions of the markers in the first frame.
+		 * \returns Buffer with the marker positions for each frame from first to end.
+		 */
+		TrackBuffer trackFrames(const std::vector<cv::Mat> &images, unsigned int first, unsigned int end, const std::vector<cv::Point2f> &initMarkers) const;
+
+		/**
+		 * Execute the tracking of the markers on a sequence in chunks which are tracked concurrently. Each chunk starts at the
+		 * refined positions predicted by the coarse tracking and is checked against the previous chunk on their overlapping frames.
+		 * If they disagree, the chunk is tracked again serially from the end of the previous chunk.
+		 *
+		 * \param[in] images The images of the sequence.
+		 * \param[in] initMarkers Positions of the markers in the first frame.
+		 * \returns Buffer with the marker positions for each frame.
+		 */
+		TrackBuffer trackChunks(const std::vector<cv::Mat> &images, const std::vector<cv::Point2f> &initMarkers) const;
+
+		/**
+		 * Execute a fast tracking pass on downscaled images to predict the marker positions.
+		 *
+		 * \param[in] images The images of the sequence.
+		 * \param[in] initMarkers Positions of the markers in the first frame.
+		 * \returns Buffer with the predicted marker positions for each frame in the original images.
+		 */
+		TrackBuffer trackCoarse(const std::vector<cv::Mat> &images, const std::vector<cv::Point2f> &initMarkers) const;
+
+		/**
+		 * Execute the tracking of the markers from one frame to the next one in region tracking mode.
+		 *
+		 * \param[in] prevImage The image of the previous frame.
+		 * \param[in] nextImage The image of the next frame.
+		 * \param[in] prevMarkers Positions of the markers in the previous frame.
+		 * \returns Vector of marker positions in the next frame.
+		 */
+		std::vector<cv::Point2f> trackRegions(const cv::Mat &prevImage, const cv::Mat &nextImage, const std::vector<cv::Point2f> &prevMarkers) const;
+
+		/**
+		 * Calculate the regions around the markers the tracking is restricted to. Overlapping regions are merged.
+		 *
+		 * \param[in] markers Positions of the markers.
+		 * \param[in] imageSize Size of the images.
+		 * \param[out] regions The merged regions inside of the images.
+		 * \param[out] regionMarkers Indices of the markers inside of each region.
+		 */
+		static void getTrackingRegions(const std::vector<cv::Point2f> &markers, const cv::Size &imageSize, std::vector<cv::Rect> &regions, std::vector<std::vector<unsigned int>> &regionMarkers);
+
+		/**
+		 * Calibration data.
+		 */
+		const Calibration &calib;
+
+		/**
+		 * Flag indicating whether the image pyramids are only built for regions around the markers.
+		 */
+		const bool regionTracking;
+
+		/**
+		 * Number of chunks a sequence is split into for tracking.
+		 */
+		const unsigned int chunks;
+	};
 }
\ No newline at end of file
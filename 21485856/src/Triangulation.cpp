@@ -1,90 +1,457 @@
-#include "Triangulation.hpp"
-
-using namespace CVLab;
-using namespace cv;
-using namespace std;
-
-Triangulation::Triangulation(const Calibration &c) : calib(c) {
-}
-
-Triangulation::Triangulation(const Triangulation &other) : calib(other.calib) {
-}
-
-vector<Point3f> Triangulation::operator()(const vector<Point2f> &markers1, const vector<Point2f> &markers2) const {
-	//triangulate the positions for a single frame
-	
-	//throw "Triangulation::operator() is not implemented";
-	vector<Point3f> resultofFrame;
-	//resultofFrame.resize(2);
-	Mat pnts3D;
-	Mat extrinCamera1 = (Mat_<float>(3, 4) << 1,0,0,0,0,1,0,0,0,0,1,0);
-	Mat projMatCamera1 = Mat_<float>(3, 4);
-	Mat projMatCamera2 = Mat_<float>(3, 4);
-	
-	//calculate projection matrix of camere
-	projMatCamera1 = calib.getCamera1()*extrinCamera1;
-	projMatCamera2 = calib.getCamera2()*calib.getTransCamera1Camera2();
-
-	Mat fundMat = calib.getFundamentalMat();
-	//projecting 3D points into the image plane using a perspective transformation
-	//http://docs.opencv.org/2.4/modules/calib3d/doc/camera_calibration_and_3d_reconstruction.html
-	correctMatches(fundMat, markers1, markers2,markers1, markers2);
-	//Reconstructs points by triangulation
-	triangulatePoints(projMatCamera1, projMatCamera2, markers1, markers2, pnts3D);
-	
-	//prepare Input vector of N-dimensional points for function convertPointsFromHomogeneous
-	Mat expandTrans;
-	calib.getTransCamera1World().copyTo(expandTrans);
-	Mat elmemt4expand = (Mat_<float>(1, 4) << 0, 0, 0, 1);
-	expandTrans.push_back(elmemt4expand);
-	//cerr << expandTrans << endl;
-
-	Mat result = expandTrans * pnts3D;
-	//Converts points from homogeneous to Euclidean space
-	convertPointsFromHomogeneous(result.t(), resultofFrame);
-
-	//resultofFrame.insert(); //result.col(0);
-
-	return resultofFrame;
-}
-
-vector<vector<Point3f>> Triangulation::operator()(const vector<vector<Point2f>> &markers1, const vector<vector<Point2f>> &markers2) const {
-	//triangulate the positions for a whole sequence
-	
-	// do nothing if there is no data
-	if (markers1.empty()) {
-		return vector<vector<Point3f>>();
-	}
-
-	// check for same number of frames
-	if (markers1.size() != markers2.size()) {
-		throw "different number of frames";
-	}
-
-	// create result vector
-	vector<vector<Point3f>> result(markers1.size());
-
-	// trinagulate each frame for itself and store result
-	for (unsigned int i = 0; i < markers1.size(); ++i) {
-		result[i] = (*this)(markers1[i], markers2[i]);
-	}
-	
-	// and return result
-	return result;
-}
-
-
-vector<vector<Point3f>> Triangulation::calculateMotion(const vector<vector<Point3f>> &data) {
-	//get the triangulated marker data and will calculate the motion from it. 
-	//The motion is nothing but the marker position relative to the first marker in the first frame.
-	//throw "Triangulation::calculateMotion is not implemented";
-
-	vector<vector<Point3f>> output;
-	output.resize(data.size(), vector<Point3f>(2));
-
-	for (int i = 0; i < data.size(); i++){
-		subtract(data[i], data[0], output[i]);
-	}
-
-	return  output;
-}
+#include "Triangulation.hpp"
+#include <cmath>
+
+#include "Profiler.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+namespace {
+#ifdef __AVX2__
+	/**
+	 * Four double precision values which are processed at once with AVX2 instructions. The arithmetic operators
+	 * allow to use the same triangulation kernel for single observations and for lanes of observations.
+	 */
+	struct Lanes {
+		Lanes() {
+		}
+
+		Lanes(double value) : v(_mm256_set1_pd(value)) {
+		}
+
+		Lanes(__m256d value) : v(value) {
+		}
+
+		__m256d v;
+	};
+
+	inline Lanes operator+(const Lanes &a, const Lanes &b) {
+		return _mm256_add_pd(a.v, b.v);
+	}
+
+	inline Lanes operator-(const Lanes &a, const Lanes &b) {
+		return _mm256_sub_pd(a.v, b.v);
+	}
+
+	inline Lanes operator*(const Lanes &a, const Lanes &b) {
+		return _mm256_mul_pd(a.v, b.v);
+	}
+
+	inline Lanes operator/(const Lanes &a, const Lanes &b) {
+		return _mm256_div_pd(a.v, b.v);
+	}
+
+	inline Lanes &operator+=(Lanes &a, const Lanes &b) {
+		return a = a + b;
+	}
+
+	inline Lanes &operator-=(Lanes &a, const Lanes &b) {
+		return a = a - b;
+	}
+
+	inline Lanes sqrt(const Lanes &a) {
+		return _mm256_sqrt_pd(a.v);
+	}
+#endif
+
+	/**
+	 * Correct an observation with the first-order approximation of Sampson. The observation is moved along the
+	 * gradient of the epipolar constraint until the linearized constraint is satisfied.
+	 *
+	 * \param[in] fund Fundamental matrix.
+	 * \param[in,out] x1 X coordinate in the first camera.
+	 * \param[in,out] y1 Y coordinate in the first camera.
+	 * \param[in,out] x2 X coordinate in the second camera.
+	 * \param[in,out] y2 Y coordinate in the second camera.
+	 */
+	template<typename T>
+	inline void correctSampson(const Matx33d &fund, T &x1, T &y1, T &x2, T &y2) {
+		// epipolar lines in both cameras and the residual of the epipolar constraint
+		const T n0 = T(fund(0, 0)) * x1 + T(fund(0, 1)) * y1 + T(fund(0, 2));
+		const T n1 = T(fund(1, 0)) * x1 + T(fund(1, 1)) * y1 + T(fund(1, 2));
+		const T m0 = T(fund(0, 0)) * x2 + T(fund(1, 0)) * y2 + T(fund(2, 0));
+		const T m1 = T(fund(0, 1)) * x2 + T(fund(1, 1)) * y2 + T(fund(2, 1));
+		const T residual = x2 * n0 + y2 * n1 + T(fund(2, 0)) * x1 + T(fund(2, 1)) * y1 + T(fund(2, 2));
+
+		// move the observations along the gradient
+		const T lambda = residual / (n0 * n0 + n1 * n1 + m0 * m0 + m1 * m1);
+		x1 -= lambda * m0;
+		y1 -= lambda * m1;
+		x2 -= lambda * n0;
+		y2 -= lambda * n1;
+	}
+
+	/**
+	 * Correct an observation to the observation with the minimal reprojection error that satisfies the epipolar
+	 * constraint. This uses the two iterations of Lindstrom ("Triangulation Made Easy", 2010), which reach the same
+	 * minimum as the polynomial of Hartley and Sturm up to numerical precision, but without branches and root finding.
+	 *
+	 * \param[in] fund Fundamental matrix.
+	 * \param[in,out] x1 X coordinate in the first camera.
+	 * \param[in,out] y1 Y coordinate in the first camera.
+	 * \param[in,out] x2 X coordinate in the second camera.
+	 * \param[in,out] y2 Y coordinate in the second camera.
+	 */
+	template<typename T>
+	inline void correctOptimal(const Matx33d &fund, T &x1, T &y1, T &x2, T &y2) {
+		using std::sqrt;
+
+		// epipolar lines in both cameras and the residual of the epipolar constraint
+		T n0 = T(fund(0, 0)) * x1 + T(fund(0, 1)) * y1 + T(fund(0, 2));
+		T n1 = T(fund(1, 0)) * x1 + T(fund(1, 1)) * y1 + T(fund(1, 2));
+		T m0 = T(fund(0, 0)) * x2 + T(fund(1, 0)) * y2 + T(fund(2, 0));
+		T m1 = T(fund(0, 1)) * x2 + T(fund(1, 1)) * y2 + T(fund(2, 1));
+		const T residual = x2 * n0 + y2 * n1 + T(fund(2, 0)) * x1 + T(fund(2, 1)) * y1 + T(fund(2, 2));
+
+		// first iteration
+		const T dn0 = T(fund(0, 0)) * m0 + T(fund(0, 1)) * m1;
+		const T dn1 = T(fund(1, 0)) * m0 + T(fund(1, 1)) * m1;
+		const T dm0 = T(fund(0, 0)) * n0 + T(fund(1, 0)) * n1;
+		const T dm1 = T(fund(0, 1)) * n0 + T(fund(1, 1)) * n1;
+		const T a = n0 * dn0 + n1 * dn1;
+		const T b = T(0.5) * (n0 * n0 + n1 * n1 + m0 * m0 + m1 * m1);
+		const T d = sqrt(b * b - a * residual);
+		T lambda = residual / (b + d);
+
+		// second iteration with the updated epipolar lines
+		n0 -= lambda * dn0;
+		n1 -= lambda * dn1;
+		m0 -= lambda * dm0;
+		m1 -= lambda * dm1;
+		lambda = lambda * T(2.0) * d / (n0 * n0 + n1 * n1 + m0 * m0 + m1 * m1);
+		x1 -= lambda * m0;
+		y1 -= lambda * m1;
+		x2 -= lambda * n0;
+		y2 -= lambda * n1;
+	}
+
+	/**
+	 * Correct a batch of observations with one of the correction kernels.
+	 *
+	 * \param[in] fund Fundamental matrix.
+	 * \param[in,out] observations The observations in both cameras.
+	 */
+	template<void (*correctScalar)(const Matx33d &, double &, double &, double &, double &)
+#ifdef __AVX2__
+		, void (*correctLanes)(const Matx33d &, Lanes &, Lanes &, Lanes &, Lanes &)
+#endif
+	>
+	void correctBatch(const Matx33d &fund, Triangulation::Observations &observations) {
+		const size_t size = observations.size();
+		size_t i = 0;
+
+#ifdef __AVX2__
+		// correct four observations at once
+		for (; i + 4 <= size; i += 4) {
+			Lanes x1 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.x1[i]));
+			Lanes y1 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.y1[i]));
+			Lanes x2 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.x2[i]));
+			Lanes y2 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.y2[i]));
+			correctLanes(fund, x1, y1, x2, y2);
+			_mm_storeu_ps(&observations.x1[i], _mm256_cvtpd_ps(x1.v));
+			_mm_storeu_ps(&observations.y1[i], _mm256_cvtpd_ps(y1.v));
+			_mm_storeu_ps(&observations.x2[i], _mm256_cvtpd_ps(x2.v));
+			_mm_storeu_ps(&observations.y2[i], _mm256_cvtpd_ps(y2.v));
+		}
+#endif
+
+		// correct the remaining observations one by one
+		for (; i < size; ++i) {
+			double x1 = observations.x1[i], y1 = observations.y1[i], x2 = observations.x2[i], y2 = observations.y2[i];
+			correctScalar(fund, x1, y1, x2, y2);
+			observations.x1[i] = static_cast<float>(x1);
+			observations.y1[i] = static_cast<float>(y1);
+			observations.x2[i] = static_cast<float>(x2);
+			observations.y2[i] = static_cast<float>(y2);
+		}
+	}
+
+	/**
+	 * Triangulate an observation with the direct linear transformation. Each camera contributes two rows to the
+	 * linear system. With the homogeneous coordinate fixed to one, the least squares solution is calculated from the
+	 * 3x3 normal equations with the adjugate matrix, so the kernel needs no branches and no decompositions.
+	 * The observations have to satisfy the epipolar constraint, which is the case after correcting them.
+	 *
+	 * \param[in] proj1 Projection matrix of the first camera.
+	 * \param[in] proj2 Projection matrix of the second camera.
+	 * \param[in] trans Transformation from the first camera to the world coordinate system.
+	 * \param[in] x1 X coordinate in the first camera.
+	 * \param[in] y1 Y coordinate in the first camera.
+	 * \param[in] x2 X coordinate in the second camera.
+	 * \param[in] y2 Y coordinate in the second camera.
+	 * \param[out] x X coordinate of the triangulated position.
+	 * \param[out] y Y coordinate of the triangulated position.
+	 * \param[out] z Z coordinate of the triangulated position.
+	 */
+	template<typename T>
+	inline void triangulatePoint(const Matx34d &proj1, const Matx34d &proj2, const Matx34d &trans, const T &x1, const T &y1, const T &x2, const T &y2, T &x, T &y, T &z) {
+		// set up the rows of the linear system
+		T rows[4][4];
+		for (int col = 0; col < 4; ++col) {
+			rows[0][col] = x1 * T(proj1(2, col)) - T(proj1(0, col));
+			rows[1][col] = y1 * T(proj1(2, col)) - T(proj1(1, col));
+			rows[2][col] = x2 * T(proj2(2, col)) - T(proj2(0, col));
+			rows[3][col] = y2 * T(proj2(2, col)) - T(proj2(1, col));
+		}
+
+		// accumulate the symmetric normal equations
+		T m00(0.0), m01(0.0), m02(0.0), m11(0.0), m12(0.0), m22(0.0), b0(0.0), b1(0.0), b2(0.0);
+		for (int row = 0; row < 4; ++row) {
+			m00 += rows[row][0] * rows[row][0];
+			m01 += rows[row][0] * rows[row][1];
+			m02 += rows[row][0] * rows[row][2];
+			m11 += rows[row][1] * rows[row][1];
+			m12 += rows[row][1] * rows[row][2];
+			m22 += rows[row][2] * rows[row][2];
+			b0 -= rows[row][0] * rows[row][3];
+			b1 -= rows[row][1] * rows[row][3];
+			b2 -= rows[row][2] * rows[row][3];
+		}
+
+		// solve them with the adjugate matrix
+		const T c00 = m11 * m22 - m12 * m12;
+		const T c01 = m02 * m12 - m01 * m22;
+		const T c02 = m01 * m12 - m02 * m11;
+		const T c11 = m00 * m22 - m02 * m02;
+		const T c12 = m01 * m02 - m00 * m12;
+		const T c22 = m00 * m11 - m01 * m01;
+		const T invDet = T(1.0) / (m00 * c00 + m01 * c01 + m02 * c02);
+		const T px = (c00 * b0 + c01 * b1 + c02 * b2) * invDet;
+		const T py = (c01 * b0 + c11 * b1 + c12 * b2) * invDet;
+		const T pz = (c02 * b0 + c12 * b1 + c22 * b2) * invDet;
+
+		// transform the position into the world coordinate system
+		x = T(trans(0, 0)) * px + T(trans(0, 1)) * py + T(trans(0, 2)) * pz + T(trans(0, 3));
+		y = T(trans(1, 0)) * px + T(trans(1, 1)) * py + T(trans(1, 2)) * pz + T(trans(1, 3));
+		z = T(trans(2, 0)) * px + T(trans(2, 1)) * py + T(trans(2, 2)) * pz + T(trans(2, 3));
+	}
+}
+
+void Triangulation::Observations::resize(size_t size) {
+	x1.resize(size);
+	y1.resize(size);
+	x2.resize(size);
+	y2.resize(size);
+}
+
+size_t Triangulation::Observations::size() const {
+	return x1.size();
+}
+
+void Triangulation::Positions::resize(size_t size) {
+	x.resize(size);
+	y.resize(size);
+	z.resize(size);
+}
+
+size_t Triangulation::Positions::size() const {
+	return x.size();
+}
+
+Triangulation::Triangulation(const Calibration &c, Correction correction) : calib(c),
+						      projMatCamera1(c.getProjectionMat(0)),
+						      projMatCamera2(c.getProjectionMat(1)),
+						      fundMat(c.getFundamentalMatx()),
+						      transCamera1World(c.getTransCamera1World()),
+						      correction(correction) {
+}
+
+Triangulation::Triangulation(const Triangulation &other) : calib(other.calib),
+							    projMatCamera1(other.projMatCamera1),
+							    projMatCamera2(other.projMatCamera2),
+							    fundMat(other.fundMat),
+							    transCamera1World(other.transCamera1World),
+							    correction(other.correction) {
+}
+
+vector<Point3f> Triangulation::operator()(const vector<Point2f> &markers1, const vector<Point2f> &markers2) const {
+	//triangulate the positions for a single frame
+	PROFILE_SCOPE("triangulate frame");
+	
+	//throw "Triangulation::operator() is not implemented";
+	vector<Point3f> resultofFrame;
+
+	// check for same number of markers
+	if (markers1.size() != markers2.size()) {
+		throw "different number of markers";
+	}
+
+	//correct each pair of observations and reconstruct the point by triangulation directly in the world coordinate system
+	resultofFrame.resize(markers1.size());
+	for (unsigned int i = 0; i < markers1.size(); ++i) {
+		double x1 = markers1[i].x, y1 = markers1[i].y, x2 = markers2[i].x, y2 = markers2[i].y;
+		if (correction == Correction::Sampson) {
+			correctSampson(fundMat, x1, y1, x2, y2);
+		} else {
+			correctOptimal(fundMat, x1, y1, x2, y2);
+		}
+		double x, y, z;
+		triangulatePoint(projMatCamera1, projMatCamera2, transCamera1World, x1, y1, x2, y2, x, y, z);
+		resultofFrame[i] = Point3f(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+	}
+
+	return resultofFrame;
+}
+
+vector<Point3f> Triangulation::operator()(const vector<Point2f> &markers1, const vector<Point2f> &markers2, const vector<Point3f> &reference, vector<Point3f> &motion) const {
+	// check for a reference with the same number of markers
+	if (!reference.empty() && (reference.size() != markers1.size())) {
+		throw "different number of markers";
+	}
+
+	// triangulate the frame and relate each position to the same marker in the reference frame
+	vector<Point3f> resultofFrame = (*this)(markers1, markers2);
+	const vector<Point3f> &base = reference.empty() ? resultofFrame : reference;
+	motion.resize(resultofFrame.size());
+	for (size_t i = 0; i < resultofFrame.size(); ++i) {
+		motion[i] = resultofFrame[i] - base[i];
+	}
+
+	return resultofFrame;
+}
+
+PointCloudSequence Triangulation::operator()(const TrackBuffer &markers1, const TrackBuffer &markers2) const {
+	return triangulateSequence(markers1, markers2, nullptr);
+}
+
+PointCloudSequence Triangulation::operator()(const TrackBuffer &markers1, const TrackBuffer &markers2, PointCloudSequence &motion) const {
+	return triangulateSequence(markers1, markers2, &motion);
+}
+
+PointCloudSequence Triangulation::triangulateSequence(const TrackBuffer &markers1, const TrackBuffer &markers2, PointCloudSequence *motion) const {
+	//triangulate the positions for a whole sequence
+	
+	// do nothing if there is no data
+	if (markers1.empty()) {
+		if (motion != nullptr) {
+			*motion = PointCloudSequence();
+		}
+		return PointCloudSequence();
+	}
+
+	// check for same number of frames and markers
+	if (markers1.getNumberOfFrames() != markers2.getNumberOfFrames()) {
+		throw "different number of frames";
+	}
+	if (markers1.getNumberOfMarkers() != markers2.getNumberOfMarkers()) {
+		throw "different number of markers";
+	}
+
+	// gather the observations of all frames, they are stored contiguously in both buffers
+	const size_t numberOfObservations = static_cast<size_t>(markers1.getNumberOfFrames()) * markers1.getNumberOfMarkers();
+	Observations observations;
+	observations.resize(numberOfObservations);
+	const Point2f *positions1 = markers1.data();
+	const Point2f *positions2 = markers2.data();
+	for (size_t i = 0; i < numberOfObservations; ++i) {
+		observations.x1[i] = positions1[i].x;
+		observations.y1[i] = positions1[i].y;
+		observations.x2[i] = positions2[i].x;
+		observations.y2[i] = positions2[i].y;
+	}
+
+	// correct all observations at once
+	correct(observations);
+
+	// triangulate the whole batch
+	Positions positions;
+	triangulate(observations, positions);
+
+	// create result buffer with the same layout as the observations
+	PointCloudSequence result(markers1.getNumberOfFrames(), markers1.getNumberOfMarkers());
+	Point3f *resultPositions = result.data();
+	if (motion == nullptr) {
+		for (size_t i = 0; i < numberOfObservations; ++i) {
+			resultPositions[i] = Point3f(positions.x[i], positions.y[i], positions.z[i]);
+		}
+	} else {
+		// the observations of the first frame come first, so the reference of each position is at the index of its marker
+		*motion = PointCloudSequence(markers1.getNumberOfFrames(), markers1.getNumberOfMarkers());
+		Point3f *motionPositions = motion->data();
+		const size_t numberOfMarkers = markers1.getNumberOfMarkers();
+		for (size_t i = 0; i < numberOfObservations; ++i) {
+			const size_t reference = i % numberOfMarkers;
+			resultPositions[i] = Point3f(positions.x[i], positions.y[i], positions.z[i]);
+			motionPositions[i] = Point3f(positions.x[i] - positions.x[reference], positions.y[i] - positions.y[reference], positions.z[i] - positions.z[reference]);
+		}
+	}
+	
+	// and return result
+	return result;
+}
+
+void Triangulation::correct(Observations &observations) const {
+	PROFILE_SCOPE("correct");
+#ifdef __AVX2__
+	if (correction == Correction::Sampson) {
+		correctBatch<correctSampson<double>, correctSampson<Lanes>>(fundMat, observations);
+	} else {
+		correctBatch<correctOptimal<double>, correctOptimal<Lanes>>(fundMat, observations);
+	}
+#else
+	if (correction == Correction::Sampson) {
+		correctBatch<correctSampson<double>>(fundMat, observations);
+	} else {
+		correctBatch<correctOptimal<double>>(fundMat, observations);
+	}
+#endif
+}
+
+void Triangulation::triangulate(const Observations &observations, Positions &positions) const {
+	PROFILE_SCOPE("triangulate");
+	const size_t size = observations.size();
+	positions.resize(size);
+	size_t i = 0;
+
+#ifdef __AVX2__
+	// triangulate four observations at once
+	for (; i + 4 <= size; i += 4) {
+		const Lanes x1 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.x1[i]));
+		const Lanes y1 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.y1[i]));
+		const Lanes x2 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.x2[i]));
+		const Lanes y2 = _mm256_cvtps_pd(_mm_loadu_ps(&observations.y2[i]));
+		Lanes x, y, z;
+		triangulatePoint(projMatCamera1, projMatCamera2, transCamera1World, x1, y1, x2, y2, x, y, z);
+		_mm_storeu_ps(&positions.x[i], _mm256_cvtpd_ps(x.v));
+		_mm_storeu_ps(&positions.y[i], _mm256_cvtpd_ps(y.v));
+		_mm_storeu_ps(&positions.z[i], _mm256_cvtpd_ps(z.v));
+	}
+#endif
+
+	// triangulate the remaining observations one by one
+	for (; i < size; ++i) {
+		double x, y, z;
+		triangulatePoint<double>(projMatCamera1, projMatCamera2, transCamera1World, observations.x1[i], observations.y1[i], observations.x2[i], observations.y2[i], x, y, z);
+		positions.x[i] = static_cast<float>(x);
+		positions.y[i] = static_cast<float>(y);
+		positions.z[i] = static_cast<float>(z);
+	}
+}
+
+
+PointCloudSequence Triangulation::calculateMotion(const PointCloudSequence &data) {
+	//get the triangulated marker data and will calculate the motion from it. 
+	//The motion is nothing but the marker position relative to the first marker in the first frame.
+	//throw "Triangulation::calculateMotion is not implemented";
+
+	PointCloudSequence output(data.getNumberOfFrames(), data.getNumberOfMarkers());
+	if (data.empty()) {
+		return output;
+	}
+
+	const Point3f *first = data[0];
+	for (unsigned int i = 0; i < data.getNumberOfFrames(); i++){
+		const Point3f *positions = data[i];
+		Point3f *motion = output[i];
+		for (unsigned int j = 0; j < data.getNumberOfMarkers(); j++) {
+			motion[j] = positions[j] - first[j];
+		}
+	}
+
+	return  output;
+}
@@ -1,68 +1,215 @@
-#pragma once
-
-#include <opencv2/opencv.hpp>
-#include <vector>
-#include "Calibration.hpp"
-
-namespace CVLab {
-	/**
-	 * Functor for executing the triangulation. It can be executed on a single frame or a whole sequence.
-	 * There is also a method for calculating the motion of the triangulated marker positions. This is simply
-	 * done by relating all positions to the position of the first marker in the first frame.
-	 */
-	class Triangulation {
-	public:
-		/**
-		 * Constructor.
-		 *
-		 * \param[in] c Calibration data.
-		 */
-		Triangulation(const Calibration &c);
-
-		/**
-		 * Copy Constructor. Creates an object by copying the data from another object. A deep copy of the data is created.
-		 *
-		 * \param[in] other The object to copy the data from.
-		 */
-		Triangulation(const Triangulation &other);
-
-		/**
-		 * Execute triangulation on a single frame.
-		 *
-		 * \param[in] markers1 Marker positions in the first camera.
-		 * \param[in] markers2 Marker positions in the second camera.
-		 * \returns Vector with the triangulated positions of the markers.
-		 */
-		std::vector<cv::Point3f> operator()(const std::vector<cv::Point2f> &markers1, const std::vector<cv::Point2f> &markers2) const;
-
-		/**
-		 * Execute triangulation on a sequence.
-		 *
-		 * \param[in] markers1 Marker positions for each frame in the first camera.
-		 * \param[in] markers2 Marker positions for each frame in the second camera.
-		 * \returns Vector with the triangulated marker positions for each frame.
-		 */
-		std::vector<std::vector<cv::Point3f>> operator()(const std::vector<std::vector<cv::Point2f>> &markers1, const std::vector<std::vector<cv::Point2f>> &markers2) const;
-
-		/**
-		 * Calculate the motion of the markers in a sequence.
-		 *
-		 * \param[in] data The triangulated marker data.
-		 * \returns The calculated motion of the markers.
-		 */
-		static std::vector<std::vector<cv::Point3f>> calculateMotion(const std::vector<std::vector<cv::Point3f>> &data);
-
-	private:
-		/**
-		 * Assignment operator. It is disabled as it is not possible to assign constant values.
-		 *
-		 * \param[in] other The other object that should be assigned to this one.
-		 */
-		Triangulation & operator=(const Triangulation &other);
-
-		/**
-		 * Calibration data.
-		 */
-		const Calibration &calib;
-	};
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "Calibration.hpp"
+#include "MarkerBuffer.hpp"
+
+namespace CVLab {
+	/**
+	 * Functor for executing the triangulation. It can be executed on a single frame or a whole sequence.
+	 * There is also a method for calculating the motion of the triangulated marker positions. This is simply
+	 * done by relating all positions to the position of the same marker in the first frame. The motion can also be
+	 * calculated during the triangulation, so the positions are produced and related in a single pass.
+	 * The matrices derived from the calibration data are copied into fixed-size members on construction.
+	 */
+	class Triangulation {
+	public:
+		/**
+		 * Methods for correcting the observations so that they satisfy the epipolar constraint.
+		 */
+		enum class Correction {
+			/**
+			 * First-order correction along the gradient of the epipolar constraint.
+			 */
+			Sampson,
+
+			/**
+			 * Correction to the observations with the minimal reprojection error, like the method of Hartley and Sturm.
+			 */
+			Optimal
+		};
+
+		/**
+		 * Marker observations in both cameras in structure-of-arrays form. Each index is one observation of a marker
+		 * in one frame, so the observations of all frames of a sequence can be processed in a single batch.
+		 */
+		struct Observations {
+			/**
+			 * Resize all coordinate arrays.
+			 *
+			 * \param[in] size The new number of observations.
+			 */
+			void resize(size_t size);
+
+			/**
+			 * Get the number of observations.
+			 *
+			 * \returns The number of observations.
+			 */
+			size_t size() const;
+
+			/**
+			 * Coordinates of the observations in the first camera.
+			 */
+			std::vector<float> x1, y1;
+
+			/**
+			 * Coordinates of the observations in the second camera.
+			 */
+			std::vector<float> x2, y2;
+		};
+
+		/**
+		 * Triangulated positions in structure-of-arrays form.
+		 */
+		struct Positions {
+			/**
+			 * Resize all coordinate arrays.
+			 *
+			 * \param[in] size The new number of positions.
+			 */
+			void resize(size_t size);
+
+			/**
+			 * Get the number of positions.
+			 *
+			 * \returns The number of positions.
+			 */
+			size_t size() const;
+
+			/**
+			 * Coordinates of the positions.
+			 */
+			std::vector<float> x, y, z;
+		};
+
+		/**
+		 * Constructor.
+		 *
+		 * \param[in] c Calibration data.
+		 * \param[in] correction The method for correcting the observations before triangulation.
+		 */
+		Triangulation(const Calibration &c, Correction correction = Correction::Optimal);
+
+		/**
+		 * Copy Constructor. Creates an object by copying the data from another object. A deep copy of the data is created.
+		 *
+		 * \param[in] other The object to copy the data from.
+		 */
+		Triangulation(const Triangulation &other);
+
+		/**
+		 * Execute triangulation on a single frame.
+		 *
+		 * \param[in] markers1 Marker positions in the first camera.
+		 * \param[in] markers2 Marker positions in the second camera.
+		 * \returns Vector with the triangulated positions of the markers.
+		 */
+		std::vector<cv::Point3f> operator()(const std::vector<cv::Point2f> &markers1, const std::vector<cv::Point2f> &markers2) const;
+
+		/**
+		 * Execute triangulation on a sequence.
+		 *
+		 * \param[in] markers1 Marker positions for each frame in the first camera.
+		 * \param[in] markers2 Marker positions for each frame in the second camera.
+		 * \returns Buffer with the triangulated marker positions for each frame.
+		 */
+		PointCloudSequence operator()(const TrackBuffer &markers1, const TrackBuffer &markers2) const;
+
+		/**
+		 * Execute triangulation on a single frame and calculate the motion of the markers in the same pass.
+		 *
+		 * \param[in] markers1 Marker positions in the first camera.
+		 * \param[in] markers2 Marker positions in the second camera.
+		 * \param[in] reference Triangulated positions of the reference frame. If it is empty, the frame is the reference itself.
+		 * \param[out] motion The motion of the markers relative to the reference frame.
+		 * \returns Vector with the triangulated positions of the markers.
+		 */
+		std::vector<cv::Point3f> operator()(const std::vector<cv::Point2f> &markers1, const std::vector<cv::Point2f> &markers2, const std::vector<cv::Point3f> &reference, std::vector<cv::Point3f> &motion) const;
+
+		/**
+		 * Execute triangulation on a sequence and calculate the motion of the markers relative to the first frame in the same pass.
+		 *
+		 * \param[in] markers1 Marker positions for each frame in the first camera.
+		 * \param[in] markers2 Marker positions for each frame in the second camera.
+		 * \param[out] motion Buffer with the motion of the markers for each frame.
+		 * \returns Buffer with the triangulated marker positions for each frame.
+		 */
+		PointCloudSequence operator()(const TrackBuffer &markers1, const TrackBuffer &markers2, PointCloudSequence &motion) const;
+
+		/**
+		 * Correct a batch of observations so that they satisfy the epipolar constraint. The observations are corrected
+		 * with the method selected on construction, several observations at once if AVX2 is available.
+		 *
+		 * \param[in,out] observations The observations in both cameras.
+		 */
+		void correct(Observations &observations) const;
+
+		/**
+		 * Triangulate a batch of observations which already satisfy the epipolar constraint. The linear systems of all
+		 * observations are solved in closed form, several observations at once if AVX2 is available.
+		 *
+		 * \param[in] observations The corrected observations in both cameras.
+		 * \param[out] positions The triangulated positions in the world coordinate system.
+		 */
+		void triangulate(const Observations &observations, Positions &positions) const;
+
+		/**
+		 * Calculate the motion of the markers in a sequence.
+		 *
+		 * \param[in] data The triangulated marker data.
+		 * \returns The calculated motion of the markers.
+		 */
+		static PointCloudSequence calculateMotion(const PointCloudSequence &data);
+
+	private:
+		/**
+		 * Assignment operator. It is disabled as it is not possible to assign constant values.
+		 *
+		 * \param[in] other The other object that should be assigned to this one.
+		 */
+		Triangulation & operator=(const Triangulation &other);
+
+		/**
+		 * Execute triangulation on a sequence and optionally calculate the motion of the markers in the same pass.
+		 *
+		 * \param[in] markers1 Marker positions for each frame in the first camera.
+		 * \param[in] markers2 Marker positions for each frame in the second camera.
+		 * \param[out] motion Buffer for the motion of the markers for each frame. It is not calculated if this is a null pointer.
+		 * \returns Buffer with the triangulated marker positions for each frame.
+		 */
+		PointCloudSequence triangulateSequence(const TrackBuffer &markers1, const TrackBuffer &markers2, PointCloudSequence *motion) const;
+
+		/**
+		 * Calibration data.
+		 */
+		const Calibration &calib;
+
+		/**
+		 * Projection matrix of the first camera.
+		 */
+		const cv::Matx34d projMatCamera1;
+
+		/**
+		 * Projection matrix of the second camera.
+		 */
+		const cv::Matx34d projMatCamera2;
+
+		/**
+		 * Fundamental matrix.
+		 */
+		const cv::Matx33d fundMat;
+
+		/**
+		 * Transformation from the first camera to the world coordinate system. The triangulated points are
+		 * calculated with a homogeneous coordinate of one, so the last row of the homogeneous transformation is not needed.
+		 */
+		const cv::Matx34d transCamera1World;
+
+		/**
+		 * Method for correcting the observations.
+		 */
+		const Correction correction;
+	};
 }
\ No newline at end of file
@@ -1,86 +1,524 @@
-#include <opencv2/opencv.hpp>
-
-#include "tools.hpp"
-#include "Constants.hpp"
-#include "Calibration.hpp"
-#include "Sequence.hpp"
-#include "Tracking.hpp"
-#include "Triangulation.hpp"
-#include <string>
-#include <iostream>
-
-using namespace CVLab;
-using namespace cv;
-using namespace std;
-
-int main(int argc, char **argv) {
-	try {
-		// get calibration folder, sequence folder and output file from command line
-		string calibFolder, sequenceFolder, outputFile;
-		if (argc == 4) {
-			calibFolder = string(argv[1]) + "/";
-			sequenceFolder = string(argv[2]) + "/";
-			outputFile = string(argv[3]);
-		} else {
-			cerr << "Please specify folder with calibration data, folder with sequence and output file" << endl;
-			return EXIT_FAILURE;
-		}
-
-		// load calibration data
-		logMessage("load calibration data from " + calibFolder);
-		Calibration calib(calibFolder);
-		logMessage("loaded calibration data");
-
-		// load sequence
-		logMessage("load sequence from " + sequenceFolder);
-		Sequence sequence(sequenceFolder, calib);
-		logMessage("finished loading sequence with " + to_string(sequence.getNumberOfFrames()) + " frames");
-
-		// track the markers in the sequence
-		logMessage("start tracking of markers");
-		// TODO execute tracking
-		Tracking track(calib);
-		//Tracking track2(sequence,track );
-		
-		vector<vector<Point2f>> trackingMarkers[2];
-
-		for (int i = 0; i < 2 ; i++){
-				cerr << "enterring loop" << endl;
-				trackingMarkers[i] = track(sequence[i], sequence.getMarkers(i));
-			}
-		//showSequenceMarkers(sequence[0], trackingMarkers[0], "", false);
-		//showSequenceMarkers(sequence[1], trackingMarkers[1], "", false);
-
-		logMessage("finished tracking of markers");
-
-		// triangulate the marker positions
-		logMessage("start triangulation");
-		// TODO execute triangulation
-		Triangulation triang(calib);
-		vector<vector<Point3f>> triangResult = triang(trackingMarkers[0], trackingMarkers[1]);
-		showTriangulation(triangResult,"",true);
-		logMessage("finished triangulation");
-
-		// calculate the motion of the markers
-		logMessage("calculate motion of markers");
-		// TODO calculate motion of markers
-		showTriangulation(triang.calculateMotion(triangResult), "", true);
-
-		logMessage("finished calculation of motion of markers");
-
-		// write the result to the output file
-		logMessage("write results to " + outputFile);
-		// TODO write result
-		writeResult(outputFile, triang.calculateMotion(triang(trackingMarkers[0], trackingMarkers[1])));
-		//writeResult(outputFile, triangResult);
-
-		logMessage("finished writing results");
-
-		// and exit program with code for success
-		return EXIT_SUCCESS;
-	} catch (const string &err) {
-		// print error message and exit program with code for failure
-		cerr << err << endl;
-		return EXIT_FAILURE;
-	}
-}
+#include <opencv2/opencv.hpp>
+
+#include "tools.hpp"
+#include "Constants.hpp"
+#include "Calibration.hpp"
+#include "Sequence.hpp"
+#include "Tracking.hpp"
+#include "Triangulation.hpp"
+#include "ResultWriter.hpp"
+#include "Pipeline.hpp"
+#include "Batch.hpp"
+#include "Profiler.hpp"
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <exception>
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+/**
+ * Track the markers in both cameras of a completely loaded sequence. Both cameras are tracked concurrently.
+ * If the images of the sequence are not undistorted, the tracked positions are undistorted afterwards.
+ *
+ * \param[in] sequence The sequence to track the markers in.
+ * \param[in] calib Calibration data.
+ * \param[in] track Tracking functor.
+ * \param[out] trackingMarkers The undistorted marker positions for both cameras.
+ */
+static void trackSequence(const Sequence &sequence, const Calibration &calib, const Tracking &track, TrackBuffer trackingMarkers[2]) {
+	track.trackStereo(sequence, trackingMarkers);
+	for (unsigned int i = 0; i < 2; ++i) {
+		if (!sequence.hasUndistortedImages()) {
+			calib.undistortPoints(i, trackingMarkers[i]);
+		}
+	}
+}
+
+/**
+ * Compare the results of tracking on undistorted images with the results of tracking on the distorted images
+ * and undistorting only the tracked positions. The deviations are printed to the console.
+ *
+ * \param[in] sequenceFolder The folder to load the sequence from.
+ * \param[in] calib Calibration data.
+ */
+static void compareUndistortion(const string &sequenceFolder, const Calibration &calib) {
+	Tracking track(calib);
+	Triangulation triang(calib);
+
+	// track and triangulate with both undistortion modes
+	TrackBuffer trackingMarkers[2][2];
+	PointCloudSequence triangResult[2];
+	for (unsigned int mode = 0; mode < 2; ++mode) {
+		const bool undistortImages = (mode == 0);
+		logMessage(string("load and track sequence with ") + (undistortImages ? "undistorted images" : "undistorted marker positions"));
+		Sequence sequence(sequenceFolder, calib, 0, undistortImages);
+		trackSequence(sequence, calib, track, trackingMarkers[mode]);
+		triangResult[mode] = triang(trackingMarkers[mode][0], trackingMarkers[mode][1]);
+	}
+
+	// compare the tracked positions in both cameras
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		double sum = 0, maximum = 0;
+		const unsigned int count = trackingMarkers[0][camera].getNumberOfFrames() * trackingMarkers[0][camera].getNumberOfMarkers();
+		for (unsigned int i = 0; i < count; ++i) {
+			const double d = norm(trackingMarkers[0][camera].data()[i] - trackingMarkers[1][camera].data()[i]);
+			sum += d;
+			maximum = max(maximum, d);
+		}
+		logMessage("camera " + to_string(camera + 1) + ": mean deviation of tracked positions " + to_string(sum / max(count, 1u)) + " px, maximum " + to_string(maximum) + " px");
+	}
+
+	// compare the triangulated positions
+	double sum = 0, maximum = 0;
+	const unsigned int count = triangResult[0].getNumberOfFrames() * triangResult[0].getNumberOfMarkers();
+	for (unsigned int i = 0; i < count; ++i) {
+		const double d = norm(triangResult[0].data()[i] - triangResult[1].data()[i]);
+		sum += d;
+		maximum = max(maximum, d);
+	}
+	logMessage("mean deviation of triangulated positions " + to_string(sum / max(count, 1u)) + ", maximum " + to_string(maximum));
+}
+
+/**
+ * Compare chunked tracking with serial tracking for increasing numbers of chunks. The chunks are tracked concurrently,
+ * so the number of chunks corresponds to the number of used cores. The runtime, the speedup and the deviation from the
+ * serial tracking are printed to the console for each number of chunks.
+ *
+ * \param[in] sequence The completely loaded sequence to track the markers in.
+ * \param[in] calib Calibration data.
+ * \param[in] regionTracking Flag indicating whether the image pyramids are only built for regions around the markers.
+ */
+static void compareChunkedTracking(const Sequence &sequence, const Calibration &calib, bool regionTracking) {
+	// track the first camera serially as reference
+	auto begin = chrono::steady_clock::now();
+	const TrackBuffer serialMarkers = Tracking(calib, regionTracking)(sequence[0], sequence.getMarkers(0));
+	const double serialTime = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	logMessage("serial tracking: " + to_string(serialTime) + " s");
+
+	// track with increasing numbers of chunks up to the number of cores
+	const unsigned int maxChunks = max(thread::hardware_concurrency(), 2u);
+	for (unsigned int chunks = 2; chunks <= maxChunks; chunks *= 2) {
+		begin = chrono::steady_clock::now();
+		const TrackBuffer chunkedMarkers = Tracking(calib, regionTracking, chunks)(sequence[0], sequence.getMarkers(0));
+		const double time = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+		// calculate the drift against the serial tracking
+		double sum = 0, maximum = 0;
+		const unsigned int count = serialMarkers.getNumberOfFrames() * serialMarkers.getNumberOfMarkers();
+		for (unsigned int i = 0; i < count; ++i) {
+			const double d = norm(serialMarkers.data()[i] - chunkedMarkers.data()[i]);
+			sum += d;
+			maximum = max(maximum, d);
+		}
+		logMessage(to_string(chunks) + " chunks: " + to_string(time) + " s, speedup " + to_string(serialTime / time) + ", mean drift " + to_string(sum / max(count, 1u)) + " px, maximum drift " + to_string(maximum) + " px");
+	}
+}
+
+/**
+ * Compare the correction methods of the triangulation with correctMatches of OpenCV. The markers are tracked in the
+ * sequence and the observations of all frames are corrected with each method. The runtime per correction of the whole
+ * sequence, the deviation from correctMatches and the remaining residual of the epipolar constraint are printed to the console.
+ *
+ * \param[in] sequence The completely loaded sequence to track the markers in.
+ * \param[in] calib Calibration data.
+ * \param[in] track Tracking functor.
+ */
+static void compareCorrection(const Sequence &sequence, const Calibration &calib, const Tracking &track) {
+	TrackBuffer trackingMarkers[2];
+	trackSequence(sequence, calib, track, trackingMarkers);
+	const Matx33d &fundMat = calib.getFundamentalMatx();
+
+	// gather the observations of all frames
+	const unsigned int numberOfFrames = trackingMarkers[0].getNumberOfFrames();
+	const size_t numberOfObservations = static_cast<size_t>(numberOfFrames) * trackingMarkers[0].getNumberOfMarkers();
+	Triangulation::Observations observations;
+	observations.resize(numberOfObservations);
+	for (size_t i = 0; i < numberOfObservations; ++i) {
+		observations.x1[i] = trackingMarkers[0].data()[i].x;
+		observations.y1[i] = trackingMarkers[0].data()[i].y;
+		observations.x2[i] = trackingMarkers[1].data()[i].x;
+		observations.y2[i] = trackingMarkers[1].data()[i].y;
+	}
+	logMessage("compare correction methods on " + to_string(observations.size()) + " observations");
+
+	// correct the observations frame by frame with correctMatches as reference, the rows of the buffers are used directly
+	TrackBuffer referenceMarkers[2] = { trackingMarkers[0], trackingMarkers[1] };
+	const Mat trackingMats[2] = { trackingMarkers[0].getMat(), trackingMarkers[1].getMat() };
+	const Mat referenceMats[2] = { referenceMarkers[0].getMat(), referenceMarkers[1].getMat() };
+	auto begin = chrono::steady_clock::now();
+	for (unsigned int repetition = 0; repetition < Constants::correctionBenchmarkRepetitions; ++repetition) {
+		for (unsigned int frame = 0; frame < numberOfFrames; ++frame) {
+			correctMatches(fundMat, trackingMats[0].row(frame), trackingMats[1].row(frame), referenceMats[0].row(frame), referenceMats[1].row(frame));
+		}
+	}
+	const double referenceTime = chrono::duration<double>(chrono::steady_clock::now() - begin).count() / Constants::correctionBenchmarkRepetitions;
+	logMessage("correctMatches: " + to_string(referenceTime * 1000) + " ms");
+
+	// correct the observations with both correction methods
+	const Triangulation::Correction corrections[] = { Triangulation::Correction::Sampson, Triangulation::Correction::Optimal };
+	const string names[] = { "Sampson correction", "optimal correction" };
+	for (unsigned int method = 0; method < 2; ++method) {
+		const Triangulation triang(calib, corrections[method]);
+		Triangulation::Observations corrected;
+		begin = chrono::steady_clock::now();
+		for (unsigned int repetition = 0; repetition < Constants::correctionBenchmarkRepetitions; ++repetition) {
+			corrected = observations;
+			triang.correct(corrected);
+		}
+		const double time = chrono::duration<double>(chrono::steady_clock::now() - begin).count() / Constants::correctionBenchmarkRepetitions;
+
+		// calculate the deviation from correctMatches and the residual of the epipolar constraint
+		double sum = 0, maximum = 0, residual = 0;
+		for (size_t i = 0; i < numberOfObservations; ++i) {
+			const Point2f point1(corrected.x1[i], corrected.y1[i]);
+			const Point2f point2(corrected.x2[i], corrected.y2[i]);
+			const double d = max(norm(point1 - referenceMarkers[0].data()[i]), norm(point2 - referenceMarkers[1].data()[i]));
+			sum += d;
+			maximum = max(maximum, d);
+			residual += abs(Vec3d(point2.x, point2.y, 1).dot(fundMat * Vec3d(point1.x, point1.y, 1)));
+		}
+		const double count = static_cast<double>(max(numberOfObservations, size_t(1)));
+		logMessage(names[method] + ": " + to_string(time * 1000) + " ms, speedup " + to_string(referenceTime / time) + ", mean deviation " + to_string(sum / count) + " px, maximum deviation " + to_string(maximum) + " px, mean residual " + to_string(residual / count));
+	}
+}
+
+/**
+ * Show the sorted marker positions in the first frame of both cameras.
+ *
+ * \param[in] sequence The sequence.
+ */
+static void showMarkers(const Sequence &sequence) {
+	for (unsigned int camera = 0; camera < 2; ++camera) {
+		showImageMarkers(sequence.getFrame(camera, 0), sequence.getMarkers(camera), "", false);
+	}
+}
+
+/**
+ * Print the counters of all stages of a pipeline. The stage with the highest utilization limits the throughput.
+ *
+ * \param[in] pipeline The pipeline that processed a sequence.
+ */
+static void logPipelineStatistics(const Pipeline &pipeline) {
+	for (const auto &stage : pipeline.getStatistics()) {
+		ostringstream message;
+		message << fixed << setprecision(1) << stage.name << ": " << stage.frames << " frames, " << (stage.frames / stage.elapsedTime) << " fps, "
+			<< (100.0 * stage.busyTime / stage.elapsedTime) << "% busy";
+		for (size_t i = 0; i < stage.queues.size(); ++i) {
+			const Pipeline::QueueStatistics &queue = stage.queues[i];
+			message << ", input queue " << ((stage.queues.size() > 1) ? "of camera " + to_string(i + 1) + " " : string()) << "depth " << queue.averageDepth << " on average and "
+				<< queue.maxDepth << " at most of " << queue.capacity;
+		}
+		logMessage(message.str());
+	}
+}
+
+/**
+ * Write the recorded events as Chrome trace and log their summary, if profiling has been requested.
+ *
+ * \param[in] traceFile The file to write the trace to, nothing is done if it is empty.
+ */
+static void writeProfile(const string &traceFile) {
+	if (traceFile.empty()) {
+		return;
+	}
+	Profiler::writeTrace(traceFile);
+	logMessage("wrote trace to " + traceFile);
+	Profiler::logSummary();
+}
+
+int main(int argc, char **argv) {
+	PROFILE_THREAD("main");
+	try {
+		// get calibration folder, sequence folder and output file from command line, or the manifest and output folder in batch mode
+		string calibFolder, sequenceFolder, outputFile;
+		if (argc >= 4) {
+			calibFolder = string(argv[1]) + "/";
+			sequenceFolder = string(argv[2]) + "/";
+			outputFile = string(argv[3]);
+		} else {
+			cerr << "Please specify folder with calibration data, folder with sequence and output file" << endl;
+			cerr << "or with --batch folder with calibration data, manifest file and output folder" << endl;
+			cerr << "Options: --stream=<window>          decode the sequence on demand keeping only <window> frames in memory" << endl;
+			cerr << "         --sparse-undistortion    track on the distorted images and undistort only the marker positions" << endl;
+			cerr << "         --compare-undistortion   compare the results of both undistortion modes and exit" << endl;
+			cerr << "         --cache=<file>           load the preprocessed images from <file> or create it if it is missing or outdated" << endl;
+			cerr << "         --region-tracking        build the image pyramids for tracking only for regions around the markers" << endl;
+			cerr << "         --chunks=<n>             split the sequence into <n> chunks which are tracked concurrently" << endl;
+			cerr << "         --compare-chunked-tracking  compare chunked tracking for increasing numbers of chunks with serial tracking and exit" << endl;
+			cerr << "         --sampson-correction     correct the observations with the first-order approximation before triangulation" << endl;
+			cerr << "         --compare-correction     compare the correction methods with correctMatches of OpenCV and exit" << endl;
+			cerr << "         --write-calibration-bundle  write the calibration data into a binary bundle in the calibration folder for faster loading" << endl;
+			cerr << "         --precision=<n>          write the coordinates with <n> decimal places, an output file ending with .npy is written as binary NumPy array" << endl;
+			cerr << "         --pipeline               decode, undistort, track, triangulate and write concurrently in a pipeline of stages, it cannot be combined with streaming, chunks or comparisons" << endl;
+			cerr << "         --batch                  process all sequences of the manifest, each line contains a sequence folder and an output file relative to the output folder" << endl;
+			cerr << "         --threads=<n>            number of threads for processing the sequences in batch mode, all hardware threads by default" << endl;
+			cerr << "         --headless               do not show any images, so the program runs without user input" << endl;
+			cerr << "         --render=<folder>        render the images into PNG files in <folder> instead of showing them" << endl;
+			cerr << "         --profile=<file>         write the timers and counters as Chrome trace to <file> and log their summary, needs a build with PROFILING" << endl;
+			return EXIT_FAILURE;
+		}
+
+		// get optional arguments from command line
+		unsigned int streamWindow = 0;
+		bool undistortImages = true;
+		bool compare = false;
+		string cacheFile;
+		bool regionTracking = false;
+		unsigned int chunks = 1;
+		bool compareChunks = false;
+		Triangulation::Correction correction = Triangulation::Correction::Optimal;
+		bool compareCorrections = false;
+		bool writeCalibrationBundle = false;
+		int precision = Constants::resultPrecision;
+		bool pipelined = false;
+		bool batch = false;
+		unsigned int threads = 0;
+		bool displaySelected = false;
+		string traceFile;
+		for (int i = 4; i < argc; ++i) {
+			const string arg(argv[i]);
+			if (arg.compare(0, 9, "--stream=") == 0) {
+				streamWindow = stoul(arg.substr(9));
+			} else if (arg == "--sparse-undistortion") {
+				undistortImages = false;
+			} else if (arg == "--compare-undistortion") {
+				compare = true;
+			} else if (arg.compare(0, 8, "--cache=") == 0) {
+				cacheFile = arg.substr(8);
+			} else if (arg == "--region-tracking") {
+				regionTracking = true;
+			} else if (arg.compare(0, 9, "--chunks=") == 0) {
+				chunks = stoul(arg.substr(9));
+			} else if (arg == "--compare-chunked-tracking") {
+				compareChunks = true;
+			} else if (arg == "--sampson-correction") {
+				correction = Triangulation::Correction::Sampson;
+			} else if (arg == "--compare-correction") {
+				compareCorrections = true;
+			} else if (arg == "--write-calibration-bundle") {
+				writeCalibrationBundle = true;
+			} else if (arg.compare(0, 12, "--precision=") == 0) {
+				precision = stoi(arg.substr(12));
+			} else if (arg == "--pipeline") {
+				pipelined = true;
+			} else if (arg == "--batch") {
+				batch = true;
+			} else if (arg.compare(0, 10, "--threads=") == 0) {
+				threads = stoul(arg.substr(10));
+			} else if (arg == "--headless") {
+				setDisplay(Display::None);
+				displaySelected = true;
+			} else if (arg.compare(0, 9, "--render=") == 0) {
+				setDisplay(Display::Files, arg.substr(9));
+				displaySelected = true;
+			} else if (arg.compare(0, 10, "--profile=") == 0) {
+#ifdef PROFILING
+				traceFile = arg.substr(10);
+#else
+				cerr << "Profiling is not available, build with the PROFILING option" << endl;
+				return EXIT_FAILURE;
+#endif
+			} else {
+				cerr << "Unknown option " << arg << endl;
+				return EXIT_FAILURE;
+			}
+		}
+
+		// the batch mode processes whole sequences without user input
+		if (batch) {
+			if ((streamWindow > 0) || pipelined || (chunks > 1) || compare || compareChunks || compareCorrections || !cacheFile.empty()) {
+				cerr << "The batch mode cannot be combined with streaming, pipelines, chunked tracking, caches or comparisons" << endl;
+				return EXIT_FAILURE;
+			}
+			if (!displaySelected) {
+				setDisplay(Display::None);
+			}
+		}
+
+		// the pipeline tracks frame by frame and streams the sequence itself
+		if (pipelined && ((streamWindow > 0) || (chunks > 1) || compare || compareChunks || compareCorrections)) {
+			cerr << "The pipeline cannot be combined with streaming, chunked tracking or comparisons" << endl;
+			return EXIT_FAILURE;
+		}
+
+		// load calibration data
+		logMessage("load calibration data from " + calibFolder);
+		Calibration calib(calibFolder);
+		logMessage(calib.isLoadedFromBundle() ? "loaded calibration data from bundle" : "loaded calibration data");
+
+		// write the calibration bundle if requested
+		if (writeCalibrationBundle) {
+			calib.writeBundle(calibFolder + Constants::calibrationBundleFile);
+			logMessage("wrote calibration bundle " + calibFolder + Constants::calibrationBundleFile);
+		}
+
+		// compare both undistortion modes if requested
+		if (compare) {
+			compareUndistortion(sequenceFolder, calib);
+			return EXIT_SUCCESS;
+		}
+
+		Tracking track(calib, regionTracking, chunks);
+		Triangulation triang(calib, correction);
+
+		// process all sequences of the manifest with the same calibration if requested
+		if (batch) {
+			const string manifestFile(argv[2]);
+			const vector<Batch::Entry> entries = Batch::readManifest(manifestFile, outputFile + "/");
+			ThreadPool pool(threads);
+			logMessage("process " + to_string(entries.size()) + " sequences of " + manifestFile + " with " + to_string(pool.getNumberOfThreads()) + " threads");
+			const Batch::Summary summary = Batch(calib, track, triang, undistortImages, precision)(entries, pool);
+			logMessage("processed " + to_string(summary.frames) + " frames of " + to_string(summary.sequences - summary.failedSequences) + " sequences in " + to_string(summary.time) + " s, "
+				+ to_string(summary.frames / summary.time) + " frames per second");
+			finishDisplay();
+			writeProfile(traceFile);
+			if (summary.failedSequences > 0) {
+				cerr << summary.failedSequences << " of " << summary.sequences << " sequences failed" << endl;
+				return EXIT_FAILURE;
+			}
+			return EXIT_SUCCESS;
+		}
+
+		TrackBuffer trackingMarkers[2];
+		PointCloudSequence triangResult;
+		PointCloudSequence motion;
+		unique_ptr<ResultWriter> writer;
+
+		if (pipelined) {
+			// open the sequence in streaming mode, the pipeline decodes the following frames or takes them from the cache
+			logMessage("open sequence from " + sequenceFolder + " for the pipeline");
+			Sequence sequence(sequenceFolder, calib, 2, undistortImages, cacheFile);
+			logMessage("opened sequence with " + to_string(sequence.getNumberOfFrames()) + " frames");
+			showMarkers(sequence);
+
+			// process all frames in the pipeline, which writes the motion as soon as it has been calculated
+			logMessage("start pipeline and write results to " + outputFile);
+			writer.reset(new ResultWriter(outputFile, sequence.getMarkers(0).size(), precision));
+			Pipeline pipeline(calib, track, triang);
+			pipeline(sequence, *writer, triangResult, motion);
+			logMessage("finished pipeline with " + to_string(triangResult.getNumberOfFrames()) + " frames");
+			logPipelineStatistics(pipeline);
+			showTriangulation(triangResult,"",true);
+		} else if (streamWindow > 0) {
+			// open sequence in streaming mode
+			logMessage("open sequence from " + sequenceFolder + " in streaming mode with a window of " + to_string(streamWindow) + " frames");
+			Sequence sequence(sequenceFolder, calib, streamWindow, undistortImages, cacheFile);
+			logMessage("opened sequence with " + to_string(sequence.getNumberOfFrames()) + " frames");
+			showMarkers(sequence);
+
+			// track and triangulate the markers as the frames are decoded
+			logMessage("start tracking and triangulation of markers");
+			Tracking::State trackingStates[2];
+			vector<Point2f> markers[2];
+			for (unsigned int i = 0; i < 2; ++i) {
+				track.start(sequence.getFrame(i, 0), sequence.getMarkers(i), trackingStates[i]);
+				markers[i] = trackingStates[i].getMarkers();
+				if (!undistortImages) {
+					calib.undistortPoints(i, markers[i], markers[i]);
+				}
+				trackingMarkers[i] = TrackBuffer(markers[i].size());
+				trackingMarkers[i].reserve(sequence.getNumberOfFrames());
+				trackingMarkers[i].appendFrame(markers[i]);
+			}
+			// the first frame is the reference for the motion, which is calculated while triangulating
+			vector<Point3f> frameMotion;
+			const vector<Point3f> firstPositions = triang(markers[0], markers[1], vector<Point3f>(), frameMotion);
+			triangResult = PointCloudSequence(markers[0].size());
+			triangResult.reserve(sequence.getNumberOfFrames());
+			triangResult.appendFrame(firstPositions);
+			motion = PointCloudSequence(markers[0].size());
+			motion.reserve(sequence.getNumberOfFrames());
+			motion.appendFrame(frameMotion);
+
+			// the motion of each frame is written in the background as soon as it has been triangulated
+			logMessage("write results to " + outputFile + " while tracking");
+			writer.reset(new ResultWriter(outputFile, markers[0].size(), precision));
+			writer->write(frameMotion);
+			while (sequence.readNextFrame()) {
+				const unsigned int frame = sequence.getCurrentFrame();
+				for (unsigned int i = 0; i < 2; ++i) {
+					markers[i] = track.step(sequence.getFrame(i, frame), trackingStates[i]);
+					if (!undistortImages) {
+						calib.undistortPoints(i, markers[i], markers[i]);
+					}
+					trackingMarkers[i].appendFrame(markers[i]);
+				}
+				triangResult.appendFrame(triang(markers[0], markers[1], firstPositions, frameMotion));
+				motion.appendFrame(frameMotion);
+				writer->write(frameMotion);
+			}
+			logMessage("finished tracking and triangulation of " + to_string(triangResult.getNumberOfFrames()) + " frames");
+			showTriangulation(triangResult,"",true);
+		} else {
+			// load sequence
+			logMessage("load sequence from " + sequenceFolder);
+			Sequence sequence(sequenceFolder, calib, 0, undistortImages, cacheFile);
+			logMessage("finished loading sequence with " + to_string(sequence.getNumberOfFrames()) + " frames");
+			showMarkers(sequence);
+
+			// compare chunked with serial tracking if requested
+			if (compareChunks) {
+				compareChunkedTracking(sequence, calib, regionTracking);
+				return EXIT_SUCCESS;
+			}
+
+			// compare the correction methods if requested
+			if (compareCorrections) {
+				compareCorrection(sequence, calib, track);
+				return EXIT_SUCCESS;
+			}
+
+			// track the markers in the sequence
+			logMessage("start tracking of markers");
+			trackSequence(sequence, calib, track, trackingMarkers);
+			logMessage("finished tracking of markers");
+
+			// triangulate the marker positions and calculate their motion in the same pass
+			logMessage("start triangulation and calculation of motion of markers");
+			triangResult = triang(trackingMarkers[0], trackingMarkers[1], motion);
+			logMessage("finished triangulation and calculation of motion of markers");
+
+			// write the result to the output file in the background while the results are shown
+			logMessage("write results to " + outputFile);
+			writer.reset(new ResultWriter(outputFile, motion.getNumberOfMarkers(), precision));
+			for (unsigned int frame = 0; frame < motion.getNumberOfFrames(); ++frame) {
+				writer->write(motion[frame]);
+			}
+			showTriangulation(triangResult,"",true);
+		}
+
+		// show the motion of the markers
+		showTriangulation(motion, "", true);
+
+		// wait until all frames have been written
+		writer->close();
+		logMessage("finished writing results");
+
+		// wait for images rendered in the background
+		finishDisplay();
+
+		// write the profile after all instrumented code has finished
+		writeProfile(traceFile);
+
+		// and exit program with code for success
+		return EXIT_SUCCESS;
+	} catch (const string &err) {
+		// print error message and exit program with code for failure
+		cerr << err << endl;
+		return EXIT_FAILURE;
+	} catch (const char *err) {
+		cerr << err << endl;
+		return EXIT_FAILURE;
+	} catch (const exception &err) {
+		// e.g. invalid numbers in the options
+		cerr << err.what() << endl;
+		return EXIT_FAILURE;
+	}
+}
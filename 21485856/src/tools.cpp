@@ -1,186 +1,466 @@
-#include "tools.hpp"
-
-#include <fstream>
-#include <sstream>
-#include <vector>
-#include <ctime>
-#include <iomanip>
-
-#include <opencv2/opencv.hpp>
-
-#include "Constants.hpp"
-
-using namespace CVLab;
-using namespace cv;
-using namespace std;
-
-Mat CVLab::readMatrix(const string &file) {
-	// open file to read matrix
-	ifstream input(file);
-	if (!input.is_open()) {
-		throw "file " + file + " could not be opened.";
-	}
-
-	// read all lines of the file into the memory
-	vector<string> lines;
-	for (string line; getline(input, line); ) {
-		if (!line.empty()) {
-			lines.push_back(line);
-		}
-	}
-	const int rows = lines.size();
-
-	// close the file as it is not needed any more
-	input.close();
-
-	// count number of columns in the first line
-	stringstream lineStream(lines.front());
-	int cols = 0;
-	for (string entry; getline(lineStream, entry, Constants::SeparatorChar); ) {
-		if (!entry.empty()) {
-			++cols;
-		}
-	}
-
-	// create matrix and fill with the data from the file
-	Mat mat(rows, cols, CV_32F);
-	for (int row = 0; row < rows; ++row) {
-		stringstream line(lines[row]);
-		for (int col = 0; col < cols; ++col) {
-			string entry;
-			getline(line, entry, Constants::SeparatorChar);
-			mat.at<float>(row, col) = stof(entry);
-		}
-	}
-
-	// return parsed matrix
-	return mat;
-}
-
-void CVLab::checkMatrixDimensions(const Mat &mat, int rows, int cols, const string &name) {
-	if (((rows >= 0) && (mat.rows != rows)) || ((cols >= 0) && (mat.cols != cols))) {
-		throw "invalid matrix dimensions for " + name + " (is " + to_string(mat.rows) + "x" + to_string(mat.cols) + ")";
-	}
-}
-
-void CVLab::showImage(const Mat &img, const string &title, bool wait) {
-	// show the image
-	imshow(title, img);
-
-	// and wait for user input
-	if (wait) {
-		waitKey();
-	}
-}
-
-void CVLab::showImageMarkers(const Mat &img, const vector<Point2f> &markers, const string &title, bool wait) {
-	// convert input image to color image to draw the markers onto it
-	Mat markedImage(img.rows, img.cols, CV_8UC3);
-	cvtColor(img, markedImage, CV_GRAY2BGR);
-
-	// loop over all markers
-	for (unsigned int i = 0; i < markers.size(); ++i) {
-		// get color for the current marker
-		const Scalar color = Constants::getMarkerColor(i);
-
-		// draw a cross at the position of the marker
-		const Point2f &pt = markers[i];
-		line(markedImage, Point2f(pt.x - Constants::markerSize, pt.y), Point2f(pt.x + Constants::markerSize, pt.y), color);
-		line(markedImage, Point2f(pt.x, pt.y - Constants::markerSize), Point2f(pt.x, pt.y + Constants::markerSize), color);
-	}
-
-	// and show the image with the markers
-	showImage(markedImage, title, wait);
-}
-
-void CVLab::showSequenceMarkers(const vector<Mat> &images, const vector<vector<Point2f>> &markers, const string &title, bool wait) {
-	// calculate delay after each frame
-	const int delay = 1000 / Constants::frameRate;
-
-	// loop over all frames and show the image with markers
-	for (unsigned int i = 0; i < images.size(); ++i) {
-		showImageMarkers(images[i], markers[i], title, false);
-		waitKey(delay);
-	}
-
-	// wait at the last frame
-	if (wait) {
-		waitKey();
-	}
-}
-
-void CVLab::showTriangulation(const vector<vector<Point3f>> &data, const string &title, bool wait) {
-	// create white image to show the plot
-	Mat plot(640, 640, CV_8UC3);
-	plot = Scalar(255, 255, 255);
-
-	// draw axes onto the plot
-	const Scalar black(0, 0, 0);
-	arrowedLine(plot, Point2i(20, 620), Point2i(620, 620), black, 1, LINE_8, 0, 0.01);
-	arrowedLine(plot, Point2i(20, 620), Point2i(20, 20), black, 1, LINE_8, 0, 0.01);
-	putText(plot, "y", Point2i(15, 13), FONT_HERSHEY_PLAIN, 1, black);
-	putText(plot, "x", Point2i(625, 623), FONT_HERSHEY_PLAIN, 1, black);
-
-	// reorder data structure to hold motion for each marker and determine max and min x and y value
-	float xmin = numeric_limits<float>::max();
-	float xmax = numeric_limits<float>::min();
-	float ymin = numeric_limits<float>::max();
-	float ymax = numeric_limits<float>::min();
-	vector<vector<Point3f>> markerMotion(data.front().size(), vector<Point3f>(data.size()));
-	for (unsigned int frameIdx = 0; frameIdx < data.size(); ++frameIdx) {
-		for (unsigned int markerIdx = 0; markerIdx < markerMotion.size(); ++markerIdx) {
-			markerMotion[markerIdx][frameIdx] = data[frameIdx][markerIdx];
-
-			const auto &marker = markerMotion[markerIdx][frameIdx];
-			xmin = min(xmin, marker.x);
-			xmax = max(xmax, marker.x);
-			ymin = min(ymin, marker.y);
-			ymax = max(ymax, marker.y);
-		}
-	}
-
-	// calculate factor for calculating marker positions in the plot
-	const float slopeX = 600 / (xmax - xmin);
-	const float slopeY = 600 / (ymax - ymin);
-
-	// plot motion of each marker
-	for (unsigned int markerIdx = 0; markerIdx < markerMotion.size(); ++markerIdx) {
-		vector<Point> motion;
-		motion.reserve(markerMotion[markerIdx].size());
-		for (const auto &pos : markerMotion[markerIdx]) {
-			motion.push_back(Point(static_cast<int>((pos.x - xmin) * slopeX + 20.5), static_cast<int>(619.5 - (pos.y - ymin) * slopeY)));
-		}
-
-		polylines(plot, motion, false, Constants::getMarkerColor(markerIdx));
-	}
-
-	// and show the plot
-	showImage(plot, title, wait);
-}
-
-void CVLab::writeResult(const string &file, const vector<vector<Point3f>> &result) {
-	// open file for writing the result
-	ofstream f(file, ios_base::out | ios_base::trunc);
-	if (!f.is_open()) {
-		throw "could not open file " + file + " for writing result.";
-	}
-
-	// write data into the file
-	unsigned int frameIdx = 0;
-	for (const auto &frame : result) {
-		unsigned int markerIdx = 0;
-		for (const auto &marker : frame) {
-			f << to_string(frameIdx) << "," << to_string(markerIdx++) << "," << to_string(marker.x) << "," << to_string(marker.y) << "," << to_string(marker.z) << endl;
-		}
-		++frameIdx;
-	}
-}
-
-void CVLab::logMessage(const std::string &message) {
-	// get current time
-	auto t = time(nullptr);
-	auto tm = localtime(&t);
-
-	// print message with current time
-	cout << "[" << put_time(tm, "%H:%M:%S") << "] " << message << endl;
+#include "tools.hpp"
+
+#include <fstream>
+#include <vector>
+#include <ctime>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <charconv>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <cerrno>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+#include "Constants.hpp"
+#include "MappedFile.hpp"
+#include "ResultWriter.hpp"
+
+using namespace CVLab;
+using namespace cv;
+using namespace std;
+
+namespace {
+	/**
+	 * The way of presenting the images of the show functions.
+	 */
+#ifdef HEADLESS
+	Display display = Display::None;
+#else
+	Display display = Display::Window;
+#endif
+
+	/**
+	 * Folder for the rendered images.
+	 */
+	string displayFolder;
+
+	/**
+	 * Number of images that have been rendered, it is used for numbering the files.
+	 */
+	unsigned int renderedImages = 0;
+
+	/**
+	 * Images that are being written in the background, the oldest one first.
+	 */
+	deque<future<void>> pendingImages;
+
+	/**
+	 * Mutex for rendering images.
+	 */
+	mutex displayMutex;
+
+	/**
+	 * Write an image into a numbered PNG file in a background thread. If too many images are pending, the oldest one is waited for.
+	 *
+	 * \param[in] img The image to be written.
+	 * \param[in] title Title of the image, which becomes part of the file name.
+	 */
+	void renderImage(const Mat &img, const string &title) {
+		lock_guard<mutex> lock(displayMutex);
+
+		// wait for the oldest image, this also reports its errors
+		while (pendingImages.size() >= Constants::maxPendingImages) {
+			future<void> oldest = move(pendingImages.front());
+			pendingImages.pop_front();
+			oldest.get();
+		}
+
+		// create a file name from the number of the image and its title
+		string name = title.empty() ? string("image") : title;
+		for (char &c : name) {
+			if (!isalnum(static_cast<unsigned char>(c))) {
+				c = '_';
+			}
+		}
+		char number[16];
+		snprintf(number, sizeof(number), "%04u_", renderedImages++);
+		const string file = displayFolder + "/" + number + name + ".png";
+
+		// the image is copied as the caller may modify it while it is written
+		const Mat image = img.clone();
+		pendingImages.push_back(async(launch::async, [file, image]() {
+			if (!imwrite(file, image)) {
+				throw "could not write image " + file + ".";
+			}
+		}));
+	}
+
+	/**
+	 * Check whether a character is a blank inside of a line. Carriage returns are treated as blanks, so files with
+	 * Windows line endings can be read on all platforms.
+	 *
+	 * \param[in] c The character to check.
+	 */
+	inline bool isBlank(char c) {
+		return (c == ' ') || (c == '\t') || (c == '\r');
+	}
+
+	/**
+	 * Get the end of a line.
+	 *
+	 * \param[in] line Pointer to the beginning of the line.
+	 * \param[in] end Pointer to the end of the data.
+	 * \returns Pointer to the line break or to the end of the data.
+	 */
+	inline const char * findLineEnd(const char *line, const char *end) {
+		const char *lineEnd = static_cast<const char *>(memchr(line, '\n', end - line));
+		return (lineEnd != nullptr) ? lineEnd : end;
+	}
+
+	/**
+	 * Count the columns of a line. A separator at the end of the line does not start another column.
+	 *
+	 * \param[in] line Pointer to the beginning of the line.
+	 * \param[in] lineEnd Pointer to the end of the line.
+	 * \returns The number of columns, zero for an empty line.
+	 */
+	int countColumns(const char *line, const char *lineEnd) {
+		// ignore blanks at the end of the line
+		while ((lineEnd > line) && isBlank(*(lineEnd - 1))) {
+			--lineEnd;
+		}
+		if (lineEnd == line) {
+			return 0;
+		}
+
+		// count the separators
+		int cols = 1;
+		for (const char *c = line; c < lineEnd; ++c) {
+			if (*c == Constants::SeparatorChar) {
+				++cols;
+			}
+		}
+		return (*(lineEnd - 1) == Constants::SeparatorChar) ? cols - 1 : cols;
+	}
+
+	/**
+	 * Skip blanks in a line.
+	 *
+	 * \param[in] pos The current position in the line.
+	 * \param[in] lineEnd Pointer to the end of the line.
+	 * \returns Pointer to the first character that is not a blank.
+	 */
+	inline const char * skipBlanks(const char *pos, const char *lineEnd) {
+		while ((pos < lineEnd) && isBlank(*pos)) {
+			++pos;
+		}
+		return pos;
+	}
+}
+
+Mat CVLab::readMatrix(const string &file) {
+	// map the file into memory, it is parsed in place without copying the lines
+	const MappedFile mapped(file);
+	const char *begin = mapped.getData();
+	const char *end = begin + mapped.getSize();
+
+	// count the rows and check that all rows have the same number of columns
+	int rows = 0;
+	int cols = 0;
+	unsigned int lineNumber = 0;
+	for (const char *line = begin; line < end; ++lineNumber) {
+		const char *lineEnd = findLineEnd(line, end);
+		const int lineCols = countColumns(line, lineEnd);
+		if (lineCols > 0) {
+			if (rows == 0) {
+				cols = lineCols;
+			} else if (lineCols != cols) {
+				throw "line " + to_string(lineNumber + 1) + " of file " + file + " has " + to_string(lineCols) + " columns instead of " + to_string(cols) + ".";
+			}
+			++rows;
+		}
+		line = lineEnd + 1;
+	}
+	if (rows == 0) {
+		throw "file " + file + " does not contain a matrix.";
+	}
+
+	// create matrix and parse the values directly into its rows
+	Mat mat(rows, cols, CV_32F);
+	int row = 0;
+	lineNumber = 0;
+	for (const char *line = begin; line < end; ++lineNumber) {
+		const char *lineEnd = findLineEnd(line, end);
+		const char *pos = skipBlanks(line, lineEnd);
+		if (pos == lineEnd) {
+			line = lineEnd + 1;
+			continue;
+		}
+
+		float *values = mat.ptr<float>(row++);
+		for (int col = 0; col < cols; ++col) {
+			// parse the value, a leading plus sign is accepted like by stof
+			pos = skipBlanks(pos, lineEnd);
+			if ((pos < lineEnd) && (*pos == '+')) {
+				++pos;
+			}
+			const from_chars_result result = from_chars(pos, lineEnd, values[col]);
+			if (result.ec != errc()) {
+				throw "invalid value in line " + to_string(lineNumber + 1) + ", column " + to_string(col + 1) + " of file " + file + ".";
+			}
+
+			// the value must be followed by a separator, only the last one may be followed by the end of the line
+			pos = skipBlanks(result.ptr, lineEnd);
+			if ((pos < lineEnd) && (*pos == Constants::SeparatorChar)) {
+				++pos;
+			} else if ((col + 1 < cols) || (pos < lineEnd)) {
+				throw "invalid value in line " + to_string(lineNumber + 1) + ", column " + to_string(col + 1) + " of file " + file + ".";
+			}
+		}
+
+		line = lineEnd + 1;
+	}
+
+	// return parsed matrix
+	return mat;
+}
+
+void CVLab::writeMatrix(const string &file, const Mat &mat) {
+	ofstream f(file, ios_base::out | ios_base::trunc);
+	f << setprecision(12);
+	for (int row = 0; row < mat.rows; ++row) {
+		for (int col = 0; col < mat.cols; ++col) {
+			if (col > 0) {
+				f << Constants::SeparatorChar;
+			}
+			f << mat.at<double>(row, col);
+		}
+		f << "\n";
+	}
+	f.close();
+	if (f.fail()) {
+		throw "could not write matrix to file " + file;
+	}
+}
+
+void CVLab::checkMatrixDimensions(const Mat &mat, int rows, int cols, const string &name) {
+	if (((rows >= 0) && (mat.rows != rows)) || ((cols >= 0) && (mat.cols != cols))) {
+		throw "invalid matrix dimensions for " + name + " (is " + to_string(mat.rows) + "x" + to_string(mat.cols) + ")";
+	}
+}
+
+uint64_t CVLab::hashData(const void *data, size_t size, uint64_t hash) {
+	// combine every byte with the hash value
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool CVLab::getFileStatus(const string &file, uint64_t &size, int64_t &modificationTime) {
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(file.c_str(), &info) != 0) {
+		return false;
+	}
+	modificationTime = static_cast<int64_t>(info.st_mtime) * 1000000000;
+#else
+	struct stat info;
+	if (stat(file.c_str(), &info) != 0) {
+		return false;
+	}
+#ifdef __APPLE__
+	modificationTime = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+	modificationTime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+	size = static_cast<uint64_t>(info.st_size);
+	return true;
+}
+
+void CVLab::createFolder(const string &folder) {
+#ifdef _WIN32
+	const int result = _mkdir(folder.c_str());
+#else
+	const int result = mkdir(folder.c_str(), 0755);
+#endif
+	if ((result != 0) && (errno != EEXIST)) {
+		throw "could not create folder " + folder;
+	}
+}
+
+void CVLab::setDisplay(Display display, const string &folder) {
+#ifdef HEADLESS
+	if (display == Display::Window) {
+		throw string("windows are not available in a headless build.");
+	}
+#endif
+	if ((display == Display::Files) && folder.empty()) {
+		throw string("no folder for rendering images given.");
+	}
+
+	// finish the images of the previous display before switching
+	finishDisplay();
+	::display = display;
+	displayFolder = folder;
+}
+
+void CVLab::finishDisplay() {
+	lock_guard<mutex> lock(displayMutex);
+	while (!pendingImages.empty()) {
+		future<void> oldest = move(pendingImages.front());
+		pendingImages.pop_front();
+		oldest.get();
+	}
+}
+
+void CVLab::showImage(const Mat &img, const string &title, bool wait) {
+	switch (display) {
+	case Display::Window:
+#ifndef HEADLESS
+		// show the image
+		imshow(title, img);
+
+		// and wait for user input
+		if (wait) {
+			waitKey();
+		}
+#endif
+		break;
+	case Display::Files:
+		renderImage(img, title);
+		break;
+	default:
+		break;
+	}
+}
+
+void CVLab::showImageMarkers(const Mat &img, const vector<Point2f> &markers, const string &title, bool wait) {
+	// skip drawing if the image is not presented
+	if (display == Display::None) {
+		return;
+	}
+
+	// convert input image to color image to draw the markers onto it
+	Mat markedImage(img.rows, img.cols, CV_8UC3);
+	cvtColor(img, markedImage, CV_GRAY2BGR);
+
+	// loop over all markers
+	for (unsigned int i = 0; i < markers.size(); ++i) {
+		// get color for the current marker
+		const Scalar color = Constants::getMarkerColor(i);
+
+		// draw a cross at the position of the marker
+		const Point2f &pt = markers[i];
+		line(markedImage, Point2f(pt.x - Constants::markerSize, pt.y), Point2f(pt.x + Constants::markerSize, pt.y), color);
+		line(markedImage, Point2f(pt.x, pt.y - Constants::markerSize), Point2f(pt.x, pt.y + Constants::markerSize), color);
+	}
+
+	// and show the image with the markers
+	showImage(markedImage, title, wait);
+}
+
+void CVLab::showSequenceMarkers(const vector<Mat> &images, const TrackBuffer &markers, const string &title, bool wait) {
+	// skip drawing if the images are not presented
+	if (display == Display::None) {
+		return;
+	}
+
+	// calculate delay after each frame
+	const int delay = 1000 / Constants::frameRate;
+
+	// loop over all frames and show the image with markers
+	for (unsigned int i = 0; i < images.size(); ++i) {
+		showImageMarkers(images[i], markers.getFrame(i), title, false);
+#ifndef HEADLESS
+		if (display == Display::Window) {
+			waitKey(delay);
+		}
+#endif
+	}
+
+	// wait at the last frame
+#ifndef HEADLESS
+	if (wait && (display == Display::Window)) {
+		waitKey();
+	}
+#endif
+}
+
+void CVLab::showTriangulation(const PointCloudSequence &data, const string &title, bool wait) {
+	// skip plotting if the plot is not presented
+	if (display == Display::None) {
+		return;
+	}
+
+	// create white image to show the plot
+	Mat plot(640, 640, CV_8UC3);
+	plot = Scalar(255, 255, 255);
+
+	// draw axes onto the plot
+	const Scalar black(0, 0, 0);
+	arrowedLine(plot, Point2i(20, 620), Point2i(620, 620), black, 1, LINE_8, 0, 0.01);
+	arrowedLine(plot, Point2i(20, 620), Point2i(20, 20), black, 1, LINE_8, 0, 0.01);
+	putText(plot, "y", Point2i(15, 13), FONT_HERSHEY_PLAIN, 1, black);
+	putText(plot, "x", Point2i(625, 623), FONT_HERSHEY_PLAIN, 1, black);
+
+	// determine max and min x and y value
+	float xmin = numeric_limits<float>::max();
+	float xmax = numeric_limits<float>::min();
+	float ymin = numeric_limits<float>::max();
+	float ymax = numeric_limits<float>::min();
+	const size_t numberOfPositions = static_cast<size_t>(data.getNumberOfFrames()) * data.getNumberOfMarkers();
+	for (size_t i = 0; i < numberOfPositions; ++i) {
+		const auto &marker = data.data()[i];
+		xmin = min(xmin, marker.x);
+		xmax = max(xmax, marker.x);
+		ymin = min(ymin, marker.y);
+		ymax = max(ymax, marker.y);
+	}
+
+	// calculate factor for calculating marker positions in the plot
+	const float slopeX = 600 / (xmax - xmin);
+	const float slopeY = 600 / (ymax - ymin);
+
+	// plot motion of each marker
+	vector<Point> motion;
+	for (unsigned int markerIdx = 0; markerIdx < data.getNumberOfMarkers(); ++markerIdx) {
+		const auto markerMotion = data.getMarker(markerIdx);
+		motion.clear();
+		motion.reserve(markerMotion.size());
+		for (unsigned int frameIdx = 0; frameIdx < markerMotion.size(); ++frameIdx) {
+			const auto &pos = markerMotion[frameIdx];
+			motion.push_back(Point(static_cast<int>((pos.x - xmin) * slopeX + 20.5), static_cast<int>(619.5 - (pos.y - ymin) * slopeY)));
+		}
+
+		polylines(plot, motion, false, Constants::getMarkerColor(markerIdx));
+	}
+
+	// and show the plot
+	showImage(plot, title, wait);
+}
+
+void CVLab::writeResult(const string &file, const PointCloudSequence &result, int precision) {
+	// queue all frames and wait until they have been written
+	ResultWriter writer(file, result.getNumberOfMarkers(), precision);
+	for (unsigned int frameIdx = 0; frameIdx < result.getNumberOfFrames(); ++frameIdx) {
+		writer.write(result[frameIdx]);
+	}
+	writer.close();
+}
+
+void CVLab::logMessage(const std::string &message) {
+	// messages of several threads must not be interleaved
+	static mutex logMutex;
+	lock_guard<mutex> lock(logMutex);
+
+	// get current time
+	auto t = time(nullptr);
+	auto tm = localtime(&t);
+
+	// print message with current time
+	cout << "[" << put_time(tm, "%H:%M:%S") << "] " << message << endl;
 }
\ No newline at end of file
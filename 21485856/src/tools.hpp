@@ -1,76 +1,150 @@
-#pragma once
-
-#include <opencv2/opencv.hpp>
-#include <vector>
-
-namespace CVLab {
-	/**
-	 * Read a matrix from file.
-	 *
-	 * \param[in] file The file to read the matrix from.
-	 */
-	cv::Mat readMatrix(const std::string &file);
-
-	/**
-	 * Check matrix dimensions and throw exception if they are not correct.
-	 * If the value for a dimension is negative, it is not checked.
-	 *
-	 * \param[in] mat Matrix to check the dimensions for.
-	 * \param[in] rows Correct number of rows.
-	 * \param[in] cols Correct number of columns.
-	 * \param[in] name Name of the matrix for the exception message.
-	 */
-	void checkMatrixDimensions(const cv::Mat &mat, int rows, int cols, const std::string &name = "given matrix");
-
-	/**
-	 * Show an image.
-	 *
-	 * \param[in] img The image to be shown.
-	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the new one.
-	 * \param[in] wait Flag indicating whether to wait for user input.
-	 */
-	void showImage(const cv::Mat &img, const std::string &title = "image", bool wait = true);
-
-	/**
-	 * Show an image with markers on it.
-	 *
-	 * \param[in] img The image to be shown.
-	 * \param[in] markers The positions of the markers to be shown on the image.
-	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the new one.
-	 * \param[in] wait Flag indicating whether to wait for user input.
-	 */
-	void showImageMarkers(const cv::Mat &img, const std::vector<cv::Point2f> &markers, const std::string &title = "markers", bool wait = true);
-
-	/**
-	 * Show a sequence of images with markers on it.
-	 *
-	 * \param[in] images The sequence of images.
-	 * \param[in] markers Positions of the markers to be shown on the images.
-	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the new one.
-	 * \param[in] wait Flag indicating whether to wait for user input after the last image.
-	 */
-	void showSequenceMarkers(const std::vector<cv::Mat> &images, const std::vector<std::vector<cv::Point2f>> &markers, const std::string &title = "sequence with markers", bool wait = true);
-
-	/**
-	 * Show triangulation result. Only the x- and y-values are shown.
-	 * \param[in] data Triangulation result.
-	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the traingulation result.
-	 * \param[in] wait Flag indicating whether to wait for user input.
-	 */
-	void showTriangulation(const std::vector<std::vector<cv::Point3f>> &data, const std::string &title = "triangulation", bool wait = true);
-
-	/**
-	 * Write the triangulation result to a file.
-	 *
-	 * \param[in] file The file to save the triangulation result to.
-	 * \param[in] result Triangulation result to write to the file.
-	 */
-	void writeResult(const std::string &file, const std::vector<std::vector<cv::Point3f>> &result);
-
-	/**
-	 * Print a message to the console prepended with the current time.
-	 *
-	 * \param[in] message The message to be printed.
-	 */
-	void logMessage(const std::string &message);
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <cstdint>
+#include "MarkerBuffer.hpp"
+#include "Constants.hpp"
+
+namespace CVLab {
+	/**
+	 * Read a matrix from file.
+	 *
+	 * \param[in] file The file to read the matrix from.
+	 */
+	cv::Mat readMatrix(const std::string &file);
+
+	/**
+	 * Write a matrix to file in the format read by readMatrix.
+	 *
+	 * \param[in] file The file to write the matrix to.
+	 * \param[in] mat The matrix of type CV_64F.
+	 */
+	void writeMatrix(const std::string &file, const cv::Mat &mat);
+
+	/**
+	 * Check matrix dimensions and throw exception if they are not correct.
+	 * If the value for a dimension is negative, it is not checked.
+	 *
+	 * \param[in] mat Matrix to check the dimensions for.
+	 * \param[in] rows Correct number of rows.
+	 * \param[in] cols Correct number of columns.
+	 * \param[in] name Name of the matrix for the exception message.
+	 */
+	void checkMatrixDimensions(const cv::Mat &mat, int rows, int cols, const std::string &name = "given matrix");
+
+	/**
+	 * Calculate the 64 bit FNV-1a hash of a block of memory.
+	 *
+	 * \param[in] data Start of the memory block.
+	 * \param[in] size Size of the memory block in bytes.
+	 * \param[in] hash Hash value to continue from, e.g. the hash of a preceding block.
+	 */
+	uint64_t hashData(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+	/**
+	 * Get the size and the time of the last modification of a file.
+	 *
+	 * \param[in] file The file.
+	 * \param[out] size Size of the file in bytes.
+	 * \param[out] modificationTime The modification time in nanoseconds, its resolution depends on the file system.
+	 * \returns False if the file does not exist.
+	 */
+	bool getFileStatus(const std::string &file, uint64_t &size, int64_t &modificationTime);
+
+	/**
+	 * Create a folder if it does not exist yet.
+	 *
+	 * \param[in] folder The folder.
+	 */
+	void createFolder(const std::string &folder);
+
+	/**
+	 * Ways of presenting the images of the show functions.
+	 */
+	enum class Display {
+		/**
+		 * Show the images in windows and wait for user input if requested. It is not available in headless builds.
+		 */
+		Window,
+
+		/**
+		 * Render the images into PNG files in background threads. The show functions never wait in this mode.
+		 */
+		Files,
+
+		/**
+		 * Skip all images, so the show functions do nothing.
+		 */
+		None
+	};
+
+	/**
+	 * Select how the images of the show functions are presented. Images that are still being rendered are finished first.
+	 * The default is Display::Window, or Display::None in headless builds.
+	 *
+	 * \param[in] display The way of presenting the images.
+	 * \param[in] folder Existing folder for the rendered images if the images are rendered into files.
+	 */
+	void setDisplay(Display display, const std::string &folder = "");
+
+	/**
+	 * Wait until all images that are rendered in the background have been written.
+	 */
+	void finishDisplay();
+
+	/**
+	 * Show an image.
+	 *
+	 * \param[in] img The image to be shown.
+	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the new one.
+	 * \param[in] wait Flag indicating whether to wait for user input.
+	 */
+	void showImage(const cv::Mat &img, const std::string &title = "image", bool wait = true);
+
+	/**
+	 * Show an image with markers on it.
+	 *
+	 * \param[in] img The image to be shown.
+	 * \param[in] markers The positions of the markers to be shown on the image.
+	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the new one.
+	 * \param[in] wait Flag indicating whether to wait for user input.
+	 */
+	void showImageMarkers(const cv::Mat &img, const std::vector<cv::Point2f> &markers, const std::string &title = "markers", bool wait = true);
+
+	/**
+	 * Show a sequence of images with markers on it.
+	 *
+	 * \param[in] images The sequence of images.
+	 * \param[in] markers Positions of the markers to be shown on the images.
+	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the new one.
+	 * \param[in] wait Flag indicating whether to wait for user input after the last image.
+	 */
+	void showSequenceMarkers(const std::vector<cv::Mat> &images, const TrackBuffer &markers, const std::string &title = "sequence with markers", bool wait = true);
+
+	/**
+	 * Show triangulation result. Only the x- and y-values are shown.
+	 * \param[in] data Triangulation result.
+	 * \param[in] title Title of the window. If there exists a window with the same title, the image will be replaced by the traingulation result.
+	 * \param[in] wait Flag indicating whether to wait for user input.
+	 */
+	void showTriangulation(const PointCloudSequence &data, const std::string &title = "triangulation", bool wait = true);
+
+	/**
+	 * Write the triangulation result to a file. If the file name ends with .npy, the result is written as binary
+	 * NumPy array of 32 bit floats with the shape (frames, markers, 3). Otherwise a CSV file with one line per frame
+	 * and marker is written.
+	 *
+	 * \param[in] file The file to save the triangulation result to.
+	 * \param[in] result Triangulation result to write to the file.
+	 * \param[in] precision Number of decimal places of the coordinates in a CSV file.
+	 */
+	void writeResult(const std::string &file, const PointCloudSequence &result, int precision = Constants::resultPrecision);
+
+	/**
+	 * Print a message to the console prepended with the current time. It can be called from several threads.
+	 *
+	 * \param[in] message The message to be printed.
+	 */
+	void logMessage(const std::string &message);
 }
\ No newline at end of file